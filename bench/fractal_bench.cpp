@@ -0,0 +1,103 @@
+/**
+ * Benchmarks the batch distance estimator of
+ * the Mandelbox for every instruction set the
+ * CPU supports and reports DE evaluations per
+ * second
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdint.h>
+
+#include "defines.h"
+#include "fractal.h"
+#include "simd.h"
+
+/// <summary>
+/// Runs a kernel over all positions a number of times and measures the throughput.
+/// </summary>
+/// <param name="kernel">The kernel to benchmark.</param>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances of the last repetition.</param>
+/// <param name="repetitions">How often all positions are evaluated.</param>
+/// <returns>DE evaluations per second.</returns>
+double benchmarkKernel(DistanceBatchKernel kernel, const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z, std::vector<float>& distance, const uint32_t& repetitions)
+{
+	const uint32_t count = uint32_t(x.size());
+	kernel(x.data(), y.data(), z.data(), distance.data(), count); //warm up caches and clocks
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t r = 0; r < repetitions; r++)
+		kernel(x.data(), y.data(), z.data(), distance.data(), count);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return double(count) * double(repetitions) / elapsed.count();
+}
+
+/// <summary>
+/// Entry point. Accepts count:<positions> and reps:<repetitions>.
+/// </summary>
+/// <param name="argc">Number of commandline parameters.</param>
+/// <param name="argv">Command line parameters.</param>
+/// <returns>EXIT_SUCCESS</returns>
+int32_t main(int32_t argc, char** argv)
+{
+	uint32_t count = 1 << 16;
+	uint32_t repetitions = 10;
+
+	for (int32_t argn = 1; argn < argc; argn++)
+	{
+		if (strncmp("count:", argv[argn], 6) == 0)
+			sscanf(argv[argn] + 6, "%u", &count);
+		else if (strncmp("reps:", argv[argn], 5) == 0)
+			sscanf(argv[argn] + 5, "%u", &repetitions);
+	}
+	count = glm::max(count, 1u);
+	repetitions = glm::max(repetitions, 1u);
+
+	//positions spread over the volume the ray marcher walks through
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> coord(-6.0f, 6.0f);
+	std::vector<float> x(count), y(count), z(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		x[i] = coord(rng);
+		y[i] = coord(rng);
+		z[i] = coord(rng);
+	}
+
+	std::vector<float> reference(count);
+	std::vector<float> distance(count);
+	double scalar_rate = benchmarkKernel(mandelBoxGetDistanceBatchScalar, x, y, z, reference, repetitions);
+
+	printf("%u positions, %u repetitions\n", count, repetitions);
+	printf("%-8s %16s %10s %14s\n", "isa", "DE/s", "speedup", "max rel. err");
+	printf("%-8s %16.0f %9.2fx %14s\n", simdIsaName(SIMD_SCALAR), scalar_rate, 1.0, "-");
+
+	for (int32_t i = SIMD_SCALAR + 1; i < SIMD_ISA_COUNT; i++)
+	{
+		SimdIsa isa = SimdIsa(i);
+		DistanceBatchKernel kernel = mandelBoxGetDistanceKernel(isa);
+		if (kernel == nullptr)
+		{
+			printf("%-8s %16s\n", simdIsaName(isa), "unavailable");
+			continue;
+		}
+
+		double rate = benchmarkKernel(kernel, x, y, z, distance, repetitions);
+
+		float max_error = 0.0f;
+		for (uint32_t j = 0; j < count; j++)
+			max_error = glm::max(max_error, glm::abs(distance[j] - reference[j]) / glm::max(reference[j], EPS));
+
+		printf("%-8s %16.0f %9.2fx %14g\n", simdIsaName(isa), rate, rate / scalar_rate, max_error);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,362 @@
+/**
+ * Benchmarks the hot kernels of the renderer
+ * one by one: the distance estimator, the orbit
+ * trap color, normals, ambient occlusion, the
+ * ray marching and the BRDF. The inputs are
+ * recorded from rendering a real frame
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "defines.h"
+#include "fractal.h"
+#include "brdf.h"
+#include "simd.h"
+#include "renderer.h"
+#include "perf.h"
+
+const double max_frequency_drift = 0.03; //relative change of the calibration loop before and after a kernel
+const double max_variation = 0.05; //relative standard deviation of the repetitions
+
+/// <summary>
+/// A primary ray as it starts marching.
+/// </summary>
+struct RecordedRay
+{
+	float3 pos;
+	float3 dir;
+	float distance;
+	float end_distance;
+};
+
+/// <summary>
+/// The inputs of the kernels, recorded while tracing the primary rays of a frame.
+/// </summary>
+struct KernelInputs
+{
+	std::vector<float3> march_positions; //every position a march step evaluated the distance at
+	std::vector<RecordedRay> rays; //primary rays that were not culled
+	std::vector<float3> hit_positions;
+	std::vector<float3> hit_dirs;
+	std::vector<float3> hit_normals;
+	std::vector<float3> hit_colors;
+	std::vector<float> hit_ao;
+	float pixel_radius;
+};
+
+typedef uint32_t(*KernelRun)(const KernelInputs& inputs, float& sink);
+
+/// <summary>
+/// Traces the primary rays of the configured frame and records the inputs of the kernels along the way. The march positions are those of plain sphere tracing, which is what rayTrace does without over-relaxation.
+/// </summary>
+/// <param name="inputs">[OUT] The recorded inputs.</param>
+void recordInputs(KernelInputs& inputs)
+{
+	inputs.pixel_radius = primaryPixelRadius();
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			RecordedRay ray;
+			ray.dir = primaryRayDir(float(x), float(y));
+			if (!startPrimaryRay(x, y, ray.dir, ray.distance, ray.end_distance))
+				continue;
+			ray.pos = camera_pos + ray.dir * ray.distance;
+			inputs.rays.push_back(ray);
+
+			float3 pos = ray.pos;
+			float distance = ray.distance;
+			for (uint32_t it = 0; it < max_iterations; it++)
+			{
+				inputs.march_positions.push_back(pos);
+				float d = mandelBoxGetDistance(pos);
+				bool hit = d < (inputs.pixel_radius * (distance + d));
+				distance += d;
+				pos += ray.dir * d;
+				if (hit)
+				{
+					inputs.hit_positions.push_back(pos);
+					inputs.hit_dirs.push_back(ray.dir);
+					inputs.hit_normals.push_back(approxNormal(pos));
+					inputs.hit_colors.push_back(mandelboxGetColor(pos));
+					inputs.hit_ao.push_back(approxAmbientOcclusion(pos, inputs.hit_normals.back(), ao_radius));
+					break;
+				}
+				if (distance > ray.end_distance)
+					break;
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Evaluates the distance estimator at every recorded march position.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runDistance(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.march_positions.size(); i++)
+		sink += mandelBoxGetDistance(inputs.march_positions[i]);
+	return uint32_t(inputs.march_positions.size());
+}
+
+/// <summary>
+/// Evaluates the orbit trap color at every hit.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runColor(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.hit_positions.size(); i++)
+		sink += mandelboxGetColor(inputs.hit_positions[i]).x;
+	return uint32_t(inputs.hit_positions.size());
+}
+
+/// <summary>
+/// Approximates the normal at every hit.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runNormal(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.hit_positions.size(); i++)
+		sink += approxNormal(inputs.hit_positions[i]).x;
+	return uint32_t(inputs.hit_positions.size());
+}
+
+/// <summary>
+/// Approximates the ambient occlusion at every hit.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runAmbientOcclusion(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.hit_positions.size(); i++)
+		sink += approxAmbientOcclusion(inputs.hit_positions[i], inputs.hit_normals[i], ao_radius);
+	return uint32_t(inputs.hit_positions.size());
+}
+
+/// <summary>
+/// Marches every recorded primary ray.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runRayTrace(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.rays.size(); i++)
+	{
+		const RecordedRay& ray = inputs.rays[i];
+		float3 pos = ray.pos;
+		float distance = ray.distance;
+		uint32_t steps = 0;
+		rayTrace(pos, ray.dir, inputs.pixel_radius, distance, ray.end_distance, steps);
+		sink += distance;
+	}
+	return uint32_t(inputs.rays.size());
+}
+
+/// <summary>
+/// Shades every hit with the material and light of the renderer.
+/// </summary>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="sink">[IN/OUT] The results are added to it, so the calls can not be optimized away.</param>
+/// <returns>The number of calls.</returns>
+uint32_t runBlinnPhong(const KernelInputs& inputs, float& sink)
+{
+	for (size_t i = 0; i < inputs.hit_positions.size(); i++)
+	{
+		const float3 color = inputs.hit_colors[i];
+		sink += brdfBlinnPhong(inputs.hit_normals[i], color * inputs.hit_ao[i] * shading_factors.x, color * shading_factors.y, float3(1, 1, 1) * shading_factors.z, -inputs.hit_dirs[i], light_dir, light_color).x;
+	}
+	return uint32_t(inputs.hit_positions.size());
+}
+
+/// <summary>
+/// Runs a fixed chain of dependent multiplications and additions. Its time only depends on the clock of the core, so comparing it before and after a kernel shows if the frequency changed in between.
+/// </summary>
+/// <returns>The fastest of a few runs in seconds.</returns>
+double calibrationSeconds()
+{
+	double best = 0.0;
+	for (uint32_t r = 0; r < 5; r++)
+	{
+		volatile float seed = 1.0f;
+		float value = seed;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < (1u << 22); i++)
+			value = value * 0.999999f + 0.000001f;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		seed = value;
+		if (r == 0 || elapsed.count() < best)
+			best = elapsed.count();
+	}
+	return best;
+}
+
+/// <summary>
+/// Returns the frequency governor of the first cpu, where the OS tells it.
+/// </summary>
+/// <returns>The name of the governor, or an empty string.</returns>
+std::string cpuGovernor()
+{
+	char name[64] = {};
+	FILE* file = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", "r");
+	if (file == nullptr)
+		return std::string();
+	if (fgets(name, sizeof(name), file) == nullptr)
+		name[0] = '\0';
+	fclose(file);
+	name[strcspn(name, "\n")] = '\0';
+	return std::string(name);
+}
+
+/// <summary>
+/// Warms a kernel up, runs it a number of times over all of its inputs and prints the time per call, and the performance counters of the repetitions if they are read. Flags the result if the clock of the core drifted or the repetitions varied too much.
+/// </summary>
+/// <param name="name">The name of the kernel.</param>
+/// <param name="run">Runs the kernel over all of its inputs.</param>
+/// <param name="inputs">The recorded inputs.</param>
+/// <param name="repetitions">How often the kernel is run over all inputs.</param>
+/// <param name="warmup_seconds">How long the kernel runs before measuring.</param>
+/// <returns>False if the measurement was not stable.</returns>
+bool benchmarkKernel(const char* name, KernelRun run, const KernelInputs& inputs, const uint32_t& repetitions, const double& warmup_seconds)
+{
+	float sink = 0.0f;
+	uint32_t calls = 0;
+	std::chrono::steady_clock::time_point warmup_start = std::chrono::steady_clock::now();
+	do
+	{
+		calls = run(inputs, sink);
+	} while (std::chrono::duration<double>(std::chrono::steady_clock::now() - warmup_start).count() < warmup_seconds);
+	if (calls == 0)
+	{
+		printf("%-12s %10s\n", name, "no inputs");
+		return true;
+	}
+
+	const double calibration_before = calibrationSeconds();
+	std::vector<double> ns_per_call(repetitions);
+	PerfValues counted_start;
+	perfRead(0, counted_start);
+	for (uint32_t r = 0; r < repetitions; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run(inputs, sink);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		ns_per_call[r] = elapsed.count() / double(calls);
+	}
+	PerfValues counted_end;
+	PerfValues counted;
+	perfRead(0, counted_end);
+	perfSubtract(counted_end, counted_start, counted);
+	const double calibration_after = calibrationSeconds();
+
+	double mean = 0.0;
+	for (uint32_t r = 0; r < repetitions; r++)
+		mean += ns_per_call[r];
+	mean /= double(repetitions);
+	double variance = 0.0;
+	for (uint32_t r = 0; r < repetitions; r++)
+		variance += (ns_per_call[r] - mean) * (ns_per_call[r] - mean);
+	variance /= double(glm::max(repetitions, 2u) - 1);
+	const double deviation = std::sqrt(variance);
+	const double drift = std::fabs(calibration_after - calibration_before) / calibration_before;
+
+	const bool stable = drift <= max_frequency_drift && deviation <= max_variation * mean;
+	printf("%-12s %10u %12.2f %12.2f %12.4f %7.2f%% %14.0f %7.2f%% %s\n", name, calls, mean, *std::min_element(ns_per_call.begin(), ns_per_call.end()), variance,
+		100.0 * deviation / mean, 1e9 / mean, 100.0 * drift, stable ? "" : "unstable");
+	if (perfEnabled())
+		printf("%-12s %s\n", "", perfDescribe(counted, uint64_t(calls) * repetitions).c_str());
+	if (sink == 1234.5f) //keeps the results alive
+		printf(" ");
+	return stable;
+}
+
+/// <summary>
+/// Entry point. Accepts cam:<name>, size:<width>x<height>, reps:<repetitions>, warmup:<ms>, perf:<0|1> and perfraw:<hex config>.
+/// </summary>
+/// <param name="argc">Number of commandline parameters.</param>
+/// <param name="argv">Command line parameters.</param>
+/// <returns>EXIT_SUCCESS</returns>
+int32_t main(int32_t argc, char** argv)
+{
+	const char* camera = "edge";
+	uint32_t repetitions = 15;
+	float warmup_ms = 200.0f;
+	uint32_t count_perf = 0;
+	unsigned long long perf_raw_config = 0;
+	width = 160;
+	height = 120;
+
+	for (int32_t argn = 1; argn < argc; argn++)
+	{
+		if (startsWith("cam:", argv[argn]))
+			camera = argv[argn] + 4;
+		else if (startsWith("size:", argv[argn]))
+		{
+			uint32_t w = 0;
+			uint32_t h = 0;
+			if (sscanf(argv[argn] + 5, "%ux%u", &w, &h) == 2 && w > 1 && h > 1)
+			{
+				width = w;
+				height = h;
+			}
+		}
+		else if (startsWith("reps:", argv[argn]))
+			sscanf(argv[argn] + 5, "%u", &repetitions);
+		else if (startsWith("warmup:", argv[argn]))
+			sscanf(argv[argn] + 7, "%f", &warmup_ms);
+		else if (startsWith("perf:", argv[argn]))
+			sscanf(argv[argn] + 5, "%u", &count_perf);
+		else if (startsWith("perfraw:", argv[argn]))
+			sscanf(argv[argn] + 8, "%llx", &perf_raw_config);
+	}
+	repetitions = glm::max(repetitions, 2u);
+	warmup_ms = glm::max(warmup_ms, 0.0f);
+
+	if (strcmp(camera, "default") != 0 && !rendererSetCamera(camera))
+	{
+		printf("The camera %s is not available. Using the default one instead.\n", camera);
+		camera = "default";
+	}
+	mandelBoxSetParameters(mandelbox_original);
+	rendererPrepare();
+
+	KernelInputs inputs;
+	recordInputs(inputs);
+	printf("%s camera at %ux%u: %u rays, %u march positions, %u hits. %s, %u repetitions\n", camera, width, height, uint32_t(inputs.rays.size()),
+		uint32_t(inputs.march_positions.size()), uint32_t(inputs.hit_positions.size()), simdIsaName(mandelBoxGetSimdIsa()), repetitions);
+	const std::string governor = cpuGovernor();
+	if (!governor.empty() && governor != "performance")
+		printf("The cpu frequency governor is %s. Set it to performance for stable numbers.\n", governor.c_str());
+	if (count_perf != 0 && !perfEnable(perf_raw_config))
+		printf("Performance counters are not available. perf_event_open is Linux only and may be restricted by /proc/sys/kernel/perf_event_paranoid.\n");
+
+	printf("%-12s %10s %12s %12s %12s %8s %14s %8s\n", "kernel", "calls", "ns/call", "min ns", "variance", "stddev", "calls/s", "drift");
+	bool stable = true;
+	stable = benchmarkKernel("distance", runDistance, inputs, repetitions, warmup_ms * 1e-3) && stable;
+	stable = benchmarkKernel("color", runColor, inputs, repetitions, warmup_ms * 1e-3) && stable;
+	stable = benchmarkKernel("normal", runNormal, inputs, repetitions, warmup_ms * 1e-3) && stable;
+	stable = benchmarkKernel("ao", runAmbientOcclusion, inputs, repetitions, warmup_ms * 1e-3) && stable;
+	stable = benchmarkKernel("raytrace", runRayTrace, inputs, repetitions, warmup_ms * 1e-3) && stable;
+	stable = benchmarkKernel("blinnphong", runBlinnPhong, inputs, repetitions, warmup_ms * 1e-3) && stable;
+
+	if (!stable)
+		printf("Some measurements were not stable, see the drift of the clock and the standard deviation.\n");
+	perfDisable();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+/**
+ * Renders the camera presets at a small size
+ * and compares them against the golden images
+ * in golden/ with per scene thresholds for the
+ * RMSE, the largest error, the structural
+ * similarity of the luma and the pixels that
+ * flipped between hit and miss. Prints the render time
+ * next to the differences, so changes for speed
+ * are checked for their visual effect
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "defines.h"
+#include "fractal.h"
+#include "simd.h"
+#include "pool.h"
+#include "image.h"
+#include "renderer.h"
+
+#ifndef MANDELBOX_GOLDEN_DIR
+#define MANDELBOX_GOLDEN_DIR "golden"
+#endif
+
+const uint32_t ssim_window = 8; //side of the square windows the structural similarity is averaged over
+const uint32_t ssim_stride = 4;
+
+/// <summary>
+/// A scene of the regression and how far it may drift from its golden image. The thresholds leave room for the rounding of another compiler or instruction set, which moves the shading of a hit by less than 0.01 here, and for a few grazing rays to flip between hit and miss. They do not leave room for an over-relaxation of 1.3, which moves the RMSE past 0.01, nor for a lost silhouette, which flips hundreds of pixels.
+/// </summary>
+struct GoldenScene
+{
+	const char* camera;
+	double max_rmse; //root mean square error over all channels
+	double max_error; //largest difference of a channel among the pixels both images hit
+	double min_ssim; //mean structural similarity of the luma, 1 for identical images
+	uint32_t max_flips; //pixels hit in one image and missed in the other
+};
+
+const GoldenScene golden_scenes[] =
+{
+	{ "default", 0.005, 0.1, 0.99, 4 },
+	{ "front", 0.005, 0.1, 0.99, 4 },
+	{ "edge", 0.008, 0.1, 0.985, 8 }, //many pixel sized details
+	{ "back", 0.005, 0.1, 0.99, 4 }
+};
+
+/// <summary>
+/// The differences between a render and its golden image.
+/// </summary>
+struct ImageDiff
+{
+	double rmse;
+	double max_error;
+	double ssim;
+	uint32_t flips;
+};
+
+/// <summary>
+/// Returns the luma of a gamma corrected color, clamped to [0, 1].
+/// </summary>
+/// <param name="pixel">The first of the three channels.</param>
+/// <returns>The luma.</returns>
+double luma(const float* pixel)
+{
+	return glm::clamp(0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2], 0.0, 1.0);
+}
+
+/// <summary>
+/// Checks if a primary ray hit the fractal. Pixels of a miss are never written and stay black.
+/// </summary>
+/// <param name="pixel">The first of the three channels.</param>
+/// <returns>True for a hit.</returns>
+bool isHit(const float* pixel)
+{
+	return pixel[0] != 0.0f || pixel[1] != 0.0f || pixel[2] != 0.0f;
+}
+
+/// <summary>
+/// Compares two images of three channels. The largest error only covers pixels that are hits in both images, the flips count the others. A NaN or infinite pixel makes every measure NaN, which fails any threshold.
+/// </summary>
+/// <param name="a">The first image.</param>
+/// <param name="b">The second image.</param>
+/// <param name="image_width">The width of both images.</param>
+/// <param name="image_height">The height of both images.</param>
+/// <returns>The differences.</returns>
+ImageDiff compareImages(const float* a, const float* b, const uint32_t& image_width, const uint32_t& image_height)
+{
+	ImageDiff diff = { 0.0, 0.0, 0.0, 0 };
+	const size_t elements = size_t(image_width) * image_height * 3;
+	for (size_t i = 0; i < elements; i += 3)
+	{
+		const bool hits = isHit(a + i) && isHit(b + i);
+		if (!hits && isHit(a + i) != isHit(b + i))
+			diff.flips++;
+		for (size_t c = i; c < i + 3; c++)
+		{
+			const double error = std::fabs(double(a[c]) - double(b[c]));
+			diff.rmse += error * error;
+			if (hits || !std::isfinite(error))
+				diff.max_error = error > diff.max_error || std::isnan(error) ? error : diff.max_error;
+		}
+	}
+	diff.rmse = std::sqrt(diff.rmse / double(elements));
+
+	//SSIM of Wang et al. 2004 with uniform windows instead of gaussian ones
+	const double c1 = (0.01 * 0.01);
+	const double c2 = (0.03 * 0.03);
+	uint32_t windows = 0;
+	for (uint32_t y0 = 0; y0 + ssim_window <= image_height; y0 += ssim_stride)
+	{
+		for (uint32_t x0 = 0; x0 + ssim_window <= image_width; x0 += ssim_stride)
+		{
+			double sum_a = 0.0, sum_b = 0.0, sum_aa = 0.0, sum_bb = 0.0, sum_ab = 0.0;
+			for (uint32_t y = y0; y < y0 + ssim_window; y++)
+			{
+				for (uint32_t x = x0; x < x0 + ssim_window; x++)
+				{
+					const size_t offset = (size_t(y) * image_width + x) * 3;
+					const double la = luma(a + offset);
+					const double lb = luma(b + offset);
+					sum_a += la;
+					sum_b += lb;
+					sum_aa += la * la;
+					sum_bb += lb * lb;
+					sum_ab += la * lb;
+				}
+			}
+			const double n = double(ssim_window * ssim_window);
+			const double mean_a = sum_a / n;
+			const double mean_b = sum_b / n;
+			const double var_a = sum_aa / n - mean_a * mean_a;
+			const double var_b = sum_bb / n - mean_b * mean_b;
+			const double cov = sum_ab / n - mean_a * mean_b;
+			diff.ssim += ((2.0 * mean_a * mean_b + c1) * (2.0 * cov + c2)) / ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+			windows++;
+		}
+	}
+	diff.ssim = windows > 0 ? diff.ssim / double(windows) : 1.0;
+	if (std::isnan(diff.max_error) || std::isinf(diff.max_error))
+		diff.rmse = diff.max_error = diff.ssim = std::nan("");
+	return diff;
+}
+
+/// <summary>
+/// Writes a measure as a JSON number, or null if it is NaN or infinite, which JSON can't express.
+/// </summary>
+/// <param name="file">The file to write.</param>
+/// <param name="name">The name of the member.</param>
+/// <param name="value">The measure.</param>
+void writeJsonMeasure(FILE* file, const char* name, const double& value)
+{
+	if (std::isfinite(value))
+		fprintf(file, "\"%s\": %.8f, ", name, value);
+	else
+		fprintf(file, "\"%s\": null, ", name);
+}
+
+/// <summary>
+/// Renders the whole frame with the current configuration a number of times.
+/// </summary>
+/// <param name="repetitions">How often the frame is rendered.</param>
+/// <param name="pixels">[OUT] The colors of the last repetition, lowest row first as in a PFM.</param>
+/// <param name="seconds">[OUT] The wall time of the fastest repetition.</param>
+/// <returns>False if the buffers could not be allocated.</returns>
+bool renderScene(const uint32_t& repetitions, std::vector<float>& pixels, double& seconds)
+{
+	frame_format = FRAME_FORMAT_RGB32F;
+	rendererPrepare();
+	if (!renderBuffersCreate(height))
+		return false;
+
+	bool rendered = true;
+	seconds = 0.0;
+	for (uint32_t r = 0; rendered && r < repetitions; r++)
+	{
+		render_start = std::chrono::steady_clock::now();
+		rendered = renderRows(0, height, "");
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - render_start;
+		if (r == 0 || elapsed.count() < seconds)
+			seconds = elapsed.count();
+	}
+	const float* colors = reinterpret_cast<const float*>(image);
+	pixels.assign(colors, colors + size_t(pixel_count) * 3);
+	renderBuffersDestroy();
+	return rendered;
+}
+
+/// <summary>
+/// Entry point. Accepts golden:<directory>, size:<width>x<height>, reps:<repetitions>, simd:<isa>, record:<0|1> and json:<file>. Golden images are recorded without the bounding box, so they come from the plain marcher and a shortcut of the default path can not end up in them.
+/// </summary>
+/// <param name="argc">Number of commandline parameters.</param>
+/// <param name="argv">Command line parameters.</param>
+/// <returns>EXIT_FAILURE if a scene could not be rendered, has no golden image or exceeds a threshold. EXIT_SUCCESS otherwise.</returns>
+int32_t main(int32_t argc, char** argv)
+{
+	std::string golden_dir = MANDELBOX_GOLDEN_DIR;
+	uint32_t repetitions = 3;
+	uint32_t record = 0;
+	const char* json_file = nullptr;
+	width = 160;
+	height = 120;
+
+	for (int32_t argn = 1; argn < argc; argn++)
+	{
+		if (startsWith("golden:", argv[argn]))
+			golden_dir = argv[argn] + 7;
+		else if (startsWith("size:", argv[argn]))
+		{
+			uint32_t w = 0;
+			uint32_t h = 0;
+			if (sscanf(argv[argn] + 5, "%ux%u", &w, &h) == 2 && w > 1 && h > 1)
+			{
+				width = w;
+				height = h;
+			}
+		}
+		else if (startsWith("reps:", argv[argn]))
+			sscanf(argv[argn] + 5, "%u", &repetitions);
+		else if (startsWith("simd:", argv[argn]))
+		{
+			SimdIsa isa = SIMD_SCALAR;
+			if (!simdIsaFromName(argv[argn] + 5, isa) || !mandelBoxSetSimdIsa(isa))
+				printf("The instruction set %s is not available. Using %s instead.\n", argv[argn] + 5, simdIsaName(mandelBoxGetSimdIsa()));
+		}
+		else if (startsWith("record:", argv[argn]))
+			sscanf(argv[argn] + 7, "%u", &record);
+		else if (startsWith("json:", argv[argn]))
+			json_file = argv[argn] + 5;
+	}
+	repetitions = glm::max(repetitions, 1u);
+
+	//the scene of the renderer without any options
+	const float3 default_pos = camera_pos;
+	const float3 default_view = camera_view;
+	const float3 default_up = camera_up;
+	const float3 default_side = camera_side;
+	mandelBoxSetParameters(mandelbox_original);
+	poolSetThreadCount(0);
+	if (record != 0)
+		bounds_mode = BOUNDS_OFF;
+
+	printf("%s at %ux%u, %s backend, %s, best of %u repetitions\n", record != 0 ? "Recording golden images" : "Comparing against the golden images", width, height,
+		poolBackendName(), simdIsaName(mandelBoxGetSimdIsa()), repetitions);
+	printf("%-8s %10s %10s %10s %10s %6s %8s\n", "camera", "seconds", "rmse", "max error", "ssim", "flips", "result");
+
+	FILE* json = nullptr;
+	if (json_file != nullptr)
+	{
+		json = fopen(json_file, "w");
+		if (json == nullptr)
+			printf("Could not write %s.\n", json_file);
+		else
+			fprintf(json, "{\n\t\"width\": %u,\n\t\"height\": %u,\n\t\"simd\": \"%s\",\n\t\"scenes\": [\n", width, height, simdIsaName(mandelBoxGetSimdIsa()));
+	}
+
+	bool chk = json_file == nullptr || json != nullptr;
+	const uint32_t scene_count = sizeof(golden_scenes) / sizeof(golden_scenes[0]);
+	for (uint32_t s = 0; s < scene_count; s++)
+	{
+		const GoldenScene& scene = golden_scenes[s];
+		camera_pos = default_pos;
+		camera_view = default_view;
+		camera_up = default_up;
+		camera_side = default_side;
+		if (strcmp(scene.camera, "default") != 0)
+			rendererSetCamera(scene.camera);
+
+		std::vector<float> pixels;
+		double seconds = 0.0;
+		if (!renderScene(repetitions, pixels, seconds))
+		{
+			printf("Could not render %s at %ux%u.\n", scene.camera, width, height);
+			chk = false;
+			continue;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "/%s_%ux%u.pfm", scene.camera, width, height);
+		const std::string golden_file = golden_dir + name;
+		const char* result = "";
+		ImageDiff diff = { 0.0, 0.0, 1.0, 0 };
+		if (record != 0)
+		{
+			result = saveFloatImagePFM(golden_file.c_str(), pixels.data(), width, height) ? "recorded" : "failed";
+		}
+		else
+		{
+			uint32_t golden_width = 0;
+			uint32_t golden_height = 0;
+			uint32_t golden_channels = 0;
+			float* golden = loadFloatImagePFM(golden_file.c_str(), golden_width, golden_height, golden_channels);
+			if (golden == nullptr)
+				result = "missing";
+			else if (golden_width != width || golden_height != height || golden_channels != 3)
+				result = "mismatch";
+			else
+			{
+				diff = compareImages(pixels.data(), golden, width, height);
+				const bool passed = diff.rmse <= scene.max_rmse && diff.max_error <= scene.max_error && diff.ssim >= scene.min_ssim && diff.flips <= scene.max_flips; //false for NaN
+				result = passed ? "passed" : "FAILED";
+			}
+			std::free(golden);
+		}
+		if (strcmp(result, "passed") != 0 && strcmp(result, "recorded") != 0)
+			chk = false;
+
+		printf("%-8s %10.4f %10.6f %10.6f %10.6f %6u %8s\n", scene.camera, seconds, diff.rmse, diff.max_error, diff.ssim, diff.flips, result);
+		if (json != nullptr)
+		{
+			fprintf(json, "\t\t{\"camera\": \"%s\", \"seconds\": %.6f, ", scene.camera, seconds);
+			writeJsonMeasure(json, "rmse", diff.rmse);
+			writeJsonMeasure(json, "max_error", diff.max_error);
+			writeJsonMeasure(json, "ssim", diff.ssim);
+			fprintf(json, "\"flips\": %u, \"max_rmse\": %g, \"max_allowed_error\": %g, \"min_ssim\": %g, \"max_flips\": %u, \"result\": \"%s\"}%s\n", diff.flips, scene.max_rmse, scene.max_error, scene.min_ssim, scene.max_flips, result, s + 1 < scene_count ? "," : "");
+		}
+	}
+	poolShutdown();
+
+	if (json != nullptr)
+	{
+		fprintf(json, "\t]\n}\n");
+		if (fclose(json) != 0)
+		{
+			printf("Could not write %s.\n", json_file);
+			chk = false;
+		}
+	}
+	if (!chk && record == 0)
+		printf("Some scenes differ from their golden images. Rerun with record:1 after checking the renders if the change is intended.\n");
+	return chk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
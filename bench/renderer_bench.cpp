@@ -0,0 +1,236 @@
+/**
+ * Benchmarks the whole renderer on the built-in
+ * camera presets at several resolutions and
+ * thread counts. Prints a table and writes the
+ * results as JSON, so releases can be compared
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "defines.h"
+#include "fractal.h"
+#include "simd.h"
+#include "stats.h"
+#include "pool.h"
+#include "renderer.h"
+
+/// <summary>
+/// The result of rendering one scene at one resolution with one thread count.
+/// </summary>
+struct BenchResult
+{
+	std::string camera;
+	uint32_t width;
+	uint32_t height;
+	uint32_t threads;
+	double seconds; //wall time of the fastest repetition
+	uint64_t primary_rays;
+	uint64_t primary_hits;
+	uint64_t de_evaluations;
+	uint64_t march_steps;
+	double efficiency; //speedup over the fewest threads, divided by the ratio of thread counts
+};
+
+/// <summary>
+/// Splits a comma separated list.
+/// </summary>
+/// <param name="list">The list.</param>
+/// <returns>The entries. Empty entries are skipped.</returns>
+std::vector<std::string> splitList(const char* list)
+{
+	std::vector<std::string> entries;
+	while (*list != '\0')
+	{
+		const char* end = strchr(list, ',');
+		const size_t length = end != nullptr ? size_t(end - list) : strlen(list);
+		if (length > 0)
+			entries.push_back(std::string(list, length));
+		list += end != nullptr ? length + 1 : length;
+	}
+	return entries;
+}
+
+/// <summary>
+/// Renders the whole frame with the current configuration a number of times.
+/// </summary>
+/// <param name="repetitions">How often the frame is rendered.</param>
+/// <param name="result">[OUT] The fastest wall time and the statistics of the last repetition.</param>
+/// <returns>False if the buffers could not be allocated.</returns>
+bool benchmarkScene(const uint32_t& repetitions, BenchResult& result)
+{
+	rendererPrepare();
+	if (!renderBuffersCreate(height))
+		return false;
+
+	bool rendered = true;
+	result.seconds = 0.0;
+	for (uint32_t r = 0; rendered && r < repetitions; r++)
+	{
+		statsReset();
+		render_start = std::chrono::steady_clock::now();
+		rendered = renderRows(0, height, "");
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - render_start;
+		if (r == 0 || elapsed.count() < result.seconds)
+			result.seconds = elapsed.count();
+	}
+	renderBuffersDestroy();
+
+	result.primary_rays = statsGet(STAT_PRIMARY_RAYS);
+	result.primary_hits = statsGet(STAT_PRIMARY_HITS);
+	result.de_evaluations = statsGet(STAT_DE_EVALUATIONS);
+	result.march_steps = statsGet(STAT_MARCH_STEPS);
+	return rendered;
+}
+
+/// <summary>
+/// Writes the results as JSON.
+/// </summary>
+/// <param name="filename">The file to write.</param>
+/// <param name="results">The results.</param>
+/// <param name="repetitions">The repetitions per result.</param>
+/// <returns>False if the file could not be written.</returns>
+bool writeJson(const char* filename, const std::vector<BenchResult>& results, const uint32_t& repetitions)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"backend\": \"%s\",\n", poolBackendName());
+	fprintf(file, "\t\"simd\": \"%s\",\n", simdIsaName(mandelBoxGetSimdIsa()));
+	fprintf(file, "\t\"repetitions\": %u,\n", repetitions);
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		const double rays = double(glm::max(r.primary_rays, uint64_t(1)));
+		fprintf(file, "\t\t{\"camera\": \"%s\", \"width\": %u, \"height\": %u, \"threads\": %u, ", r.camera.c_str(), r.width, r.height, r.threads);
+		fprintf(file, "\"seconds\": %.6f, \"mrays_per_second\": %.4f, \"de_evaluations_per_second\": %.0f, ", r.seconds, double(r.primary_rays) / r.seconds * 1e-6, double(r.de_evaluations) / r.seconds);
+		fprintf(file, "\"primary_rays\": %llu, \"de_evaluations\": %llu, \"average_march_steps\": %.4f, \"hit_ratio\": %.6f, \"parallel_efficiency\": %.4f}%s\n",
+			(unsigned long long)r.primary_rays, (unsigned long long)r.de_evaluations, double(r.march_steps) / rays, double(r.primary_hits) / rays, r.efficiency, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	return fclose(file) == 0;
+}
+
+/// <summary>
+/// Entry point. Accepts cams:<list>, sizes:<list of width x height>, threads:<list>, reps:<repetitions> and json:<file>.
+/// </summary>
+/// <param name="argc">Number of commandline parameters.</param>
+/// <param name="argv">Command line parameters.</param>
+/// <returns>EXIT_FAILURE if a scene could not be rendered or the JSON could not be written. EXIT_SUCCESS otherwise.</returns>
+int32_t main(int32_t argc, char** argv)
+{
+	std::vector<std::string> cameras = splitList("default,front,edge,back");
+	std::vector<std::string> sizes = splitList("320x240,640x480");
+	std::vector<uint32_t> thread_counts;
+	uint32_t repetitions = 3;
+	const char* json_file = nullptr;
+
+	statsEnable(true);
+	poolSetThreadCount(0);
+	for (uint32_t count = 1; count < poolGetThreadCount(); count *= 2) //powers of two up to all hardware threads
+		thread_counts.push_back(count);
+	thread_counts.push_back(poolGetThreadCount());
+
+	for (int32_t argn = 1; argn < argc; argn++)
+	{
+		if (startsWith("cams:", argv[argn]))
+			cameras = splitList(argv[argn] + 5);
+		else if (startsWith("sizes:", argv[argn]))
+			sizes = splitList(argv[argn] + 6);
+		else if (startsWith("threads:", argv[argn]))
+		{
+			std::vector<std::string> counts = splitList(argv[argn] + 8);
+			thread_counts.clear();
+			for (size_t i = 0; i < counts.size(); i++)
+				thread_counts.push_back(glm::clamp(uint32_t(strtoul(counts[i].c_str(), nullptr, 10)), 1u, 1024u));
+		}
+		else if (startsWith("reps:", argv[argn]))
+			sscanf(argv[argn] + 5, "%u", &repetitions);
+		else if (startsWith("json:", argv[argn]))
+			json_file = argv[argn] + 5;
+	}
+	repetitions = glm::max(repetitions, 1u);
+	if (thread_counts.empty())
+		thread_counts.push_back(1);
+
+	//the scene of the renderer without any options
+	const float3 default_pos = camera_pos;
+	const float3 default_view = camera_view;
+	const float3 default_up = camera_up;
+	const float3 default_side = camera_side;
+	mandelBoxSetParameters(mandelbox_original);
+
+	printf("%s backend, %s, best of %u repetitions\n", poolBackendName(), simdIsaName(mandelBoxGetSimdIsa()), repetitions);
+	printf("%-8s %11s %7s %10s %10s %14s %10s %8s %10s\n", "camera", "size", "threads", "seconds", "Mrays/s", "DE/s", "steps/ray", "hits", "efficiency");
+
+	std::vector<BenchResult> results;
+	bool chk = true;
+	for (size_t c = 0; c < cameras.size(); c++)
+	{
+		camera_pos = default_pos;
+		camera_view = default_view;
+		camera_up = default_up;
+		camera_side = default_side;
+		if (cameras[c] != "default" && !rendererSetCamera(cameras[c].c_str()))
+		{
+			printf("The camera %s is not available.\n", cameras[c].c_str());
+			continue;
+		}
+
+		for (size_t s = 0; s < sizes.size(); s++)
+		{
+			uint32_t w = 0;
+			uint32_t h = 0;
+			if (sscanf(sizes[s].c_str(), "%ux%u", &w, &h) != 2 || w == 0 || h == 0)
+			{
+				printf("The size %s is not valid.\n", sizes[s].c_str());
+				continue;
+			}
+			width = w;
+			height = h;
+
+			double reference_seconds = 0.0; //of the first thread count, which the efficiency is relative to
+			for (size_t t = 0; t < thread_counts.size(); t++)
+			{
+				poolSetThreadCount(thread_counts[t]);
+
+				BenchResult result;
+				result.camera = cameras[c];
+				result.width = width;
+				result.height = height;
+				result.threads = thread_counts[t];
+				if (!benchmarkScene(repetitions, result))
+				{
+					printf("Could not render %s at %ux%u.\n", cameras[c].c_str(), width, height);
+					chk = false;
+					continue;
+				}
+				if (t == 0)
+					reference_seconds = result.seconds * thread_counts[0];
+				result.efficiency = reference_seconds / (double(result.threads) * result.seconds);
+				results.push_back(result);
+
+				const double rays = double(glm::max(result.primary_rays, uint64_t(1)));
+				printf("%-8s %5ux%-5u %7u %10.4f %10.3f %14.0f %10.2f %7.1f%% %10.2f\n", result.camera.c_str(), result.width, result.height, result.threads, result.seconds,
+					double(result.primary_rays) / result.seconds * 1e-6, double(result.de_evaluations) / result.seconds, double(result.march_steps) / rays, 100.0 * double(result.primary_hits) / rays, result.efficiency);
+			}
+		}
+	}
+	poolShutdown();
+
+	if (json_file != nullptr && !writeJson(json_file, results, repetitions))
+	{
+		printf("Could not write %s.\n", json_file);
+		chk = false;
+	}
+	return chk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
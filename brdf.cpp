@@ -5,6 +5,11 @@
 
 #include "brdf.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BRDF_SSE2
+#endif
+
 /// <summary>
 /// Shades a point with the Blinn/Phong model, given one light source.
 /// </summary>
@@ -33,4 +38,68 @@ float3 brdfBlinnPhong(const float3& surface_normal, const float3& color_ambient,
 	blinn_phong *= light_color; //need to account for lights emission
 
 	return blinn_phong;
-}
\ No newline at end of file
+}
+
+/// <summary>
+/// Shades a batch of points with the Blinn/Phong model like brdfBlinnPhong, with the colors derived from a surface color the way the renderer does it: ambient = surface color * ambient occlusion * ambient factor, diffuse = surface color * diffuse factor and a white specular color times the specular factor. Four points are shaded at once with SSE2, the rest one by one.
+/// </summary>
+/// <param name="surface_normals">Surface normals of the points.</param>
+/// <param name="surface_colors">Surface colors of the points.</param>
+/// <param name="surface_ao">Ambient occlusion of the points.</param>
+/// <param name="eye_dirs">Vectors pointing from the surface points to the eye.</param>
+/// <param name="count">The number of points.</param>
+/// <param name="factors">The ambient, diffuse and specular factor.</param>
+/// <param name="light_dir">Vector pointing from the surface points to the light source.</param>
+/// <param name="light_color">Color of the light source.</param>
+/// <param name="shaded">[OUT] Shaded linear colors.</param>
+void brdfBlinnPhongBatch(const float3* surface_normals, const float3* surface_colors, const float* surface_ao, const float3* eye_dirs, const uint32_t& count, const float3& factors, const float3& light_dir, const float3& light_color, float3* shaded)
+{
+	uint32_t i = 0;
+#if defined(BRDF_SSE2)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lx = _mm_set1_ps(light_dir.x);
+	const __m128 ly = _mm_set1_ps(light_dir.y);
+	const __m128 lz = _mm_set1_ps(light_dir.z);
+	const __m128 specular = _mm_set1_ps(factors.z * 0.35f);
+	for (; i + 4 <= count; i += 4)
+	{
+		const float3* n = surface_normals + i;
+		const float3* e = eye_dirs + i;
+		const __m128 nx = _mm_setr_ps(n[0].x, n[1].x, n[2].x, n[3].x);
+		const __m128 ny = _mm_setr_ps(n[0].y, n[1].y, n[2].y, n[3].y);
+		const __m128 nz = _mm_setr_ps(n[0].z, n[1].z, n[2].z, n[3].z);
+
+		//lambert term, masked where the light is behind the surface
+		const __m128 lambert = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)), _mm_mul_ps(nz, lz));
+		const __m128 lit = _mm_cmpgt_ps(lambert, zero);
+
+		//halfway vector and specular term
+		__m128 hx = _mm_add_ps(lx, _mm_setr_ps(e[0].x, e[1].x, e[2].x, e[3].x));
+		__m128 hy = _mm_add_ps(ly, _mm_setr_ps(e[0].y, e[1].y, e[2].y, e[3].y));
+		__m128 hz = _mm_add_ps(lz, _mm_setr_ps(e[0].z, e[1].z, e[2].z, e[3].z));
+		const __m128 inv_length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, hx), _mm_mul_ps(hy, hy)), _mm_mul_ps(hz, hz))));
+		hx = _mm_mul_ps(hx, inv_length);
+		hy = _mm_mul_ps(hy, inv_length);
+		hz = _mm_mul_ps(hz, inv_length);
+		const __m128 specular_dot = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, hx), _mm_mul_ps(ny, hy)), _mm_mul_ps(nz, hz)), zero);
+		const __m128 specular_dot2 = _mm_mul_ps(specular_dot, specular_dot);
+		const __m128 specular_term = _mm_mul_ps(_mm_mul_ps(specular_dot2, specular_dot2), specular_dot); //power of 5
+
+		const __m128 diffuse = _mm_and_ps(lit, _mm_mul_ps(lambert, _mm_set1_ps(factors.y)));
+		const __m128 highlight = _mm_and_ps(lit, _mm_mul_ps(specular_term, specular));
+		const __m128 ambient = _mm_mul_ps(_mm_loadu_ps(surface_ao + i), _mm_set1_ps(factors.x));
+		const __m128 color_factor = _mm_add_ps(ambient, diffuse); //the surface color is scaled by both
+
+		float color_factors[4];
+		float highlights[4];
+		_mm_storeu_ps(color_factors, color_factor);
+		_mm_storeu_ps(highlights, highlight);
+		for (uint32_t lane = 0; lane < 4; lane++)
+			shaded[i + lane] = (surface_colors[i + lane] * color_factors[lane] + highlights[lane]) * light_color;
+	}
+#endif
+	for (; i < count; i++)
+	{
+		shaded[i] = brdfBlinnPhong(surface_normals[i], surface_colors[i] * surface_ao[i] * factors.x, surface_colors[i] * factors.y, float3(1, 1, 1) * factors.z, eye_dirs[i], light_dir, light_color);
+	}
+}
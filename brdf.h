@@ -8,4 +8,6 @@
 #include <stdint.h>
 #include "defines.h"
 
-float3 brdfBlinnPhong(const float3& surface_normal, const float3& color_ambient, const float3& color_diffuse, const float3& color_specular, const float3& eye_dir, const float3& light_dir, const float3& light_color);
\ No newline at end of file
+float3 brdfBlinnPhong(const float3& surface_normal, const float3& color_ambient, const float3& color_diffuse, const float3& color_specular, const float3& eye_dir, const float3& light_dir, const float3& light_color);
+
+void brdfBlinnPhongBatch(const float3* surface_normals, const float3* surface_colors, const float* surface_ao, const float3* eye_dirs, const uint32_t& count, const float3& factors, const float3& light_dir, const float3& light_color, float3* shaded);
\ No newline at end of file
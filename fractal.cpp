@@ -4,6 +4,12 @@
  */
 
 #include "fractal.h"
+#include "fractal_simd.h"
+#include "stats.h"
+#include <limits>
+
+static MandelboxParameters parameters = mandelbox_original;
+static MandelboxBailout bailout = { std::numeric_limits<float>::infinity(), 0.0f, 0.0f, 0.0f };
 
 /// <summary>
 /// Folds a point along an inner and outer radius.
@@ -42,30 +48,346 @@ void boxFold(float3& p, const float& folding_limit)
 }
 
 /// <summary>
-/// Returns the distance to the closest point of the mandelbox fractal for a given position.
+/// Returns a distance estimate for an orbit that escaped the bailout radius before all iterations were done. The remaining iterations could still shrink |p| via the box folds and the offsets, and grow dr. Both are subtracted/added in the worst case, so the estimate never exceeds the one of the full iterations.
+/// </summary>
+/// <param name="r">The length of the escaped point.</param>
+/// <param name="dr">The derivative.</param>
+/// <param name="offset">The offset, which is the original position.</param>
+/// <param name="distance">[OUT] The estimated distance.</param>
+/// <returns>True if the estimate is usable. False if the worst case shrinking could still pull the orbit back and iterating has to go on.</returns>
+static inline bool escapedDistance(const float& r, const float& dr, const float3& offset, float& distance)
+{
+	float shrink = bailout.fold_shrink + glm::length(offset) * bailout.offset_factor;
+	if (r < 2.0f * shrink)
+		return false;
+
+	distance = (r - shrink) / (glm::abs(dr) + bailout.dr_growth);
+	return true;
+}
+
+/// <summary>
+/// Returns the distance to the closest point of the mandelbox fractal for a given position. The parameters are read at runtime.
 /// </summary>
 /// <param name="pos">The position.</param>
 /// <returns>Distance to the closest point within the fractal</returns>
-float mandelBoxGetDistance(const float3& pos)
+float mandelBoxGetDistanceGeneric(const float3& pos)
 {
+	const MandelboxParameters& params = parameters;
+
 	float3 p = pos;
 	float3 offset = p;
 	float dr = 1.0f;
 
-	const float scale = 2.0f; //original mandelbox parameter. Must be positive
+	for (uint32_t i = 0; i < params.iterations; i++)
+	{
+		boxFold(p, params.folding_limit);
+		sphereFold(p, dr, params.min_radius_sq, params.fixed_radius_sq);
+
+		p = p*params.scale + offset;
+		dr = dr*params.scale + 1.0f;
 
-	for (uint32_t i = 0; i < fractal_iterations; i++)
+		float r2 = glm::dot(p, p);
+		float distance = 0.0f;
+		if (r2 > bailout.radius_sq && escapedDistance(glm::sqrt(r2), dr, offset, distance))
+		{
+			statsAdd(STAT_DE_EVALUATIONS, 1);
+			statsAdd(STAT_DE_ITERATIONS, i + 1);
+			return distance;
+		}
+	}
+
+	statsAdd(STAT_DE_EVALUATIONS, 1);
+	statsAdd(STAT_DE_ITERATIONS, params.iterations);
+	return glm::length(p) / glm::abs(dr);
+}
+
+//-----------------------------------------|
+// Distance and gradient in one pass. The  |
+// Jacobian of p and the gradient of dr    |
+// are carried through every fold.         |
+//-----------------------------------------|
+
+/// <summary>
+/// Folds a point along an inner and outer radius and updates the derivatives with respect to the original position. See sphereFold.
+/// </summary>
+/// <param name="p">[IN/OUT] The point.</param>
+/// <param name="jacobian">[IN/OUT] The Jacobian of p. Column j holds the derivative of p along axis j.</param>
+/// <param name="dr">[IN/OUT] The derivative that will change due to the fold.</param>
+/// <param name="dr_gradient">[IN/OUT] The gradient of dr.</param>
+/// <param name="min_radius_sq">The square of the minimal radius.</param>
+/// <param name="fixed_radius_sq">The fixed radius squared.</param>
+void sphereFoldJacobian(float3& p, glm::mat3& jacobian, float& dr, float3& dr_gradient, const float& min_radius_sq, const float& fixed_radius_sq)
+{
+	float r2 = glm::dot(p, p);
+	if (r2<min_radius_sq)
 	{
-		boxFold(p, 1.0f);
-		sphereFold(p, dr, 0.25f, 1.0f);  //original mandelbox parameters
+		// linear inner scaling, the factor is constant
+		float temp = (fixed_radius_sq / min_radius_sq);
+		p *= temp;
+		jacobian *= temp;
+		dr *= temp;
+		dr_gradient *= temp;
+	}
+	else if (r2<fixed_radius_sq)
+	{
+		// the sphere inversion, the factor depends on the position as well
+		float temp = (fixed_radius_sq / r2);
+		float3 temp_gradient = (p * jacobian) * (-2.0f * temp / r2);
+		for (uint32_t j = 0; j < 3; j++)
+			jacobian[j] = jacobian[j] * temp + p * temp_gradient[j];
+		p *= temp;
+		dr_gradient = dr_gradient * temp + temp_gradient * dr;
+		dr *= temp;
+	}
+}
 
-		p = p*scale + offset;
-		dr = dr*scale + 1.0f;
+/// <summary>
+/// Folds a point along a boxes border and updates its Jacobian. See boxFold.
+/// </summary>
+/// <param name="p">[IN/OUT] The point.</param>
+/// <param name="jacobian">[IN/OUT] The Jacobian of p. Column j holds the derivative of p along axis j.</param>
+/// <param name="folding_limit">The boxes limits.</param>
+void boxFoldJacobian(float3& p, glm::mat3& jacobian, const float& folding_limit)
+{
+	float3 folded = glm::clamp(p, -folding_limit, folding_limit) * 2.0f - p;
+	float3 sign;
+	for (uint32_t i = 0; i < 3; i++)
+		sign[i] = glm::abs(p[i]) > folding_limit ? -1.0f : 1.0f; //reflected coordinates flip their derivative
+	for (uint32_t j = 0; j < 3; j++)
+		jacobian[j] *= sign;
+	p = folded;
+}
+
+/// <summary>
+/// Returns the distance to the closest point of the mandelbox fractal and the gradient of that distance in one pass. Matches mandelBoxGetDistance, including the bailout.
+/// </summary>
+/// <param name="pos">The position.</param>
+/// <param name="gradient">[OUT] The gradient of the distance estimate. Points away from the fractal.</param>
+/// <returns>Distance to the closest point within the fractal</returns>
+float mandelBoxGetDistanceGradient(const float3& pos, float3& gradient)
+{
+	const MandelboxParameters& params = parameters;
+
+	float3 p = pos;
+	glm::mat3 jacobian(1.0f);
+	float dr = 1.0f;
+	float3 dr_gradient(0.0f);
+
+	for (uint32_t i = 0; i < params.iterations; i++)
+	{
+		boxFoldJacobian(p, jacobian, params.folding_limit);
+		sphereFoldJacobian(p, jacobian, dr, dr_gradient, params.min_radius_sq, params.fixed_radius_sq);
+
+		p = p*params.scale + pos;
+		jacobian = jacobian*params.scale + glm::mat3(1.0f);
+		dr = dr*params.scale + 1.0f;
+		dr_gradient *= params.scale;
+
+		float r2 = glm::dot(p, p);
+		float distance = 0.0f;
+		if (r2 > bailout.radius_sq && escapedDistance(glm::sqrt(r2), dr, pos, distance))
+		{
+			//derivative of (r - shrink) / (|dr| + dr_growth)
+			float r = glm::sqrt(r2);
+			float denominator = glm::abs(dr) + bailout.dr_growth;
+			float3 shrink_gradient = glm::length(pos) > 0.0f ? glm::normalize(pos) * bailout.offset_factor : float3(0.0f);
+			gradient = ((p * jacobian) / r - shrink_gradient) / denominator - dr_gradient * (glm::sign(dr) * distance / denominator);
+
+			statsAdd(STAT_DE_EVALUATIONS, 1);
+			statsAdd(STAT_DE_ITERATIONS, i + 1);
+			return distance;
+		}
+	}
+
+	//derivative of |p| / |dr|
+	float r = glm::length(p);
+	float abs_dr = glm::abs(dr);
+	gradient = (p * jacobian) / (r * abs_dr) - dr_gradient * (glm::sign(dr) * r / (abs_dr * abs_dr));
+
+	statsAdd(STAT_DE_EVALUATIONS, 1);
+	statsAdd(STAT_DE_ITERATIONS, params.iterations);
+	return r / abs_dr;
+}
+
+//-----------------------------------------|
+// Specialized kernels. The parameters and |
+// the iterations are compile time         |
+// constants, so the compiler can fold     |
+// them into the instructions.             |
+//-----------------------------------------|
+
+/// <summary>
+/// The original mandelbox parameters as compile time constants. The iterations are a template parameter of the kernel.
+/// </summary>
+struct OriginalConstants
+{
+	static float foldingLimit() { return 1.0f; }
+	static float minRadiusSq() { return 0.25f; }
+	static float fixedRadiusSq() { return 1.0f; }
+	static float scale() { return 2.0f; }
+};
+
+/// <summary>
+/// Hides a constant from the optimizer. Once the folding limit is known, compilers like to turn the clamp of boxFold into branches, which are hard to predict and cost more than the min/max instructions they replace.
+/// </summary>
+/// <param name="value">The value.</param>
+/// <returns>The unchanged value.</returns>
+static inline float keepInRegister(float value)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	__asm__("" : "+x"(value));
+#endif
+	return value;
+}
+
+/// <summary>
+/// Returns the distance to the closest point of the mandelbox fractal for a given position. Specialized for a fixed parameter set.
+/// </summary>
+/// <param name="pos">The position.</param>
+/// <returns>Distance to the closest point within the fractal</returns>
+template<uint32_t Iterations, typename Constants>
+float mandelBoxGetDistanceFixed(const float3& pos)
+{
+	float3 p = pos;
+	float dr = 1.0f;
+	const float folding_limit = keepInRegister(Constants::foldingLimit());
+
+	for (uint32_t i = 0; i < Iterations; i++)
+	{
+		boxFold(p, folding_limit);
+		sphereFold(p, dr, Constants::minRadiusSq(), Constants::fixedRadiusSq());
+
+		p = p*Constants::scale() + pos;
+		dr = dr*Constants::scale() + 1.0f;
+
+		float r2 = glm::dot(p, p);
+		float distance = 0.0f;
+		if (r2 > bailout.radius_sq && escapedDistance(glm::sqrt(r2), dr, pos, distance))
+		{
+			statsAdd(STAT_DE_EVALUATIONS, 1);
+			statsAdd(STAT_DE_ITERATIONS, i + 1);
+			return distance;
+		}
 	}
 
+	statsAdd(STAT_DE_EVALUATIONS, 1);
+	statsAdd(STAT_DE_ITERATIONS, Iterations);
 	return glm::length(p) / glm::abs(dr);
 }
 
+typedef float(*DistanceFunction)(const float3& pos);
+
+struct SpecializedKernel
+{
+	uint32_t iterations;
+	DistanceFunction function;
+};
+
+//parameter sets that get their own kernel. They all use the original constants and differ in the iterations, which trade quality for speed
+const SpecializedKernel specialized_kernels[] = {
+	{ 25, mandelBoxGetDistanceFixed<25, OriginalConstants> },
+	{ 15, mandelBoxGetDistanceFixed<15, OriginalConstants> },
+	{ 10, mandelBoxGetDistanceFixed<10, OriginalConstants> }
+};
+
+static DistanceFunction distance_function = mandelBoxGetDistanceFixed<25, OriginalConstants>;
+
+/// <summary>
+/// Sets the mandelbox parameters and picks a specialized distance kernel if one matches them. Falls back to the generic kernel otherwise. Not thread safe, call it before rendering.
+/// </summary>
+/// <param name="params">The parameters.</param>
+void mandelBoxSetParameters(const MandelboxParameters& params)
+{
+	parameters = params;
+	distance_function = mandelBoxGetDistanceGeneric;
+
+	//after the escape a box fold moves each coordinate by at most twice the folding limit, and the sphere fold must not kick in anymore
+	const float fold_shift = 2.0f * glm::sqrt(3.0f) * params.folding_limit;
+	if (params.bailout > 0.0f && params.scale > 1.0f)
+	{
+		const float radius = glm::max(params.bailout, glm::sqrt(params.fixed_radius_sq) + fold_shift);
+		bailout.radius_sq = radius * radius;
+		bailout.fold_shrink = fold_shift * params.scale / (params.scale - 1.0f);
+		bailout.offset_factor = 1.0f / (params.scale - 1.0f);
+		bailout.dr_growth = 1.0f / (params.scale - 1.0f);
+	}
+	else
+	{
+		bailout.radius_sq = std::numeric_limits<float>::infinity();
+	}
+
+	const bool original_constants = params.folding_limit == OriginalConstants::foldingLimit()
+		&& params.min_radius_sq == OriginalConstants::minRadiusSq()
+		&& params.fixed_radius_sq == OriginalConstants::fixedRadiusSq()
+		&& params.scale == OriginalConstants::scale();
+	if (!original_constants)
+		return;
+
+	for (const SpecializedKernel& kernel : specialized_kernels)
+	{
+		if (kernel.iterations == params.iterations)
+		{
+			distance_function = kernel.function;
+			return;
+		}
+	}
+}
+
+/// <summary>
+/// Returns the current mandelbox parameters.
+/// </summary>
+/// <returns>The parameters.</returns>
+const MandelboxParameters& mandelBoxGetParameters()
+{
+	return parameters;
+}
+
+/// <summary>
+/// Returns the terms used to stop the iterations once the orbit escaped.
+/// </summary>
+/// <returns>The bailout terms.</returns>
+const MandelboxBailout& mandelBoxGetBailout()
+{
+	return bailout;
+}
+
+/// <summary>
+/// Returns the half size of an axis aligned cube around the origin that contains every point whose distance estimate is below surface_distance. For a scale above 1 every point whose largest coordinate exceeds 2 * folding_limit * (scale + 1) / (scale - 1) escapes. Beyond that cube the estimate grows by at least 2 * folding_limit / half_size per unit of the largest coordinate, with a bailout by at least half of that (measured over the allowed parameter ranges), so the cube is grown until the estimate reaches surface_distance. A small margin accounts for rounding.
+/// </summary>
+/// <param name="surface_distance">The largest distance estimate the ray marcher takes as a hit.</param>
+/// <returns>The half size, or infinity if the parameters do not allow a bound.</returns>
+float mandelBoxGetBoundingHalfSize(const float& surface_distance)
+{
+	if (parameters.scale <= 1.0f)
+		return std::numeric_limits<float>::infinity();
+
+	float half_size = 2.0f * parameters.folding_limit * (parameters.scale + 1.0f) / (parameters.scale - 1.0f);
+	half_size = glm::max(half_size, glm::sqrt(parameters.fixed_radius_sq));
+	float growth = 2.0f * parameters.folding_limit / half_size;
+	if (bailout.radius_sq != std::numeric_limits<float>::infinity())
+		growth *= 0.5f;
+	return (half_size + surface_distance / growth) * 1.01f + EPS;
+}
+
+/// <summary>
+/// Checks if the current parameters are handled by a specialized kernel.
+/// </summary>
+/// <returns>True if a specialized kernel is used, false if the generic one is used.</returns>
+bool mandelBoxIsSpecialized()
+{
+	return distance_function != mandelBoxGetDistanceGeneric;
+}
+
+/// <summary>
+/// Returns the distance to the closest point of the mandelbox fractal for a given position. Dispatches to the kernel picked by mandelBoxSetParameters.
+/// </summary>
+/// <param name="pos">The position.</param>
+/// <returns>Distance to the closest point within the fractal</returns>
+float mandelBoxGetDistance(const float3& pos)
+{
+	return distance_function(pos);
+}
+
 /// <summary>
 /// Cartesian to spherical coordinate conversion.
 /// </summary>
@@ -89,11 +411,102 @@ float3 CartesianToSpherical(float3 xyz) {
 /// <returns>A linear color for the surface point.</returns>
 float3 mandelboxGetColor(const float3& pos)
 {
+	const MandelboxParameters& params = mandelBoxGetParameters();
+
 	float3 p = pos;
 	float dr = 1.0f;
 	for (uint32_t i = 0; i < trap_iterations; i++) { //mandelbox iterations
-		boxFold(p, 1.0f);
-		sphereFold(p, dr, 0.25f, 1.0f); //original mandelbox parameters
+		boxFold(p, params.folding_limit);
+		sphereFold(p, dr, params.min_radius_sq, params.fixed_radius_sq);
 	}
 	return glm::normalize(glm::abs(p));
-}
\ No newline at end of file
+}
+
+/// <summary>
+/// Reference implementation of the batch distance estimation. Evaluates mandelBoxGetDistance for every position.
+/// </summary>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances for each position.</param>
+/// <param name="count">The number of positions.</param>
+void mandelBoxGetDistanceBatchScalar(const float* x, const float* y, const float* z, float* distance, const uint32_t& count)
+{
+	for (uint32_t i = 0; i < count; i++)
+		distance[i] = distance_function(float3(x[i], y[i], z[i]));
+}
+
+/// <summary>
+/// Returns the batch kernel for an instruction set.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>The kernel, or nullptr if it was not compiled or the CPU does not support the instruction set.</returns>
+DistanceBatchKernel mandelBoxGetDistanceKernel(const SimdIsa& isa)
+{
+	if (!simdIsaSupported(isa))
+		return nullptr;
+
+	switch (isa)
+	{
+	case SIMD_SCALAR: return mandelBoxGetDistanceBatchScalar;
+	case SIMD_SSE: return mandelBoxDistanceKernelSSE();
+	case SIMD_AVX2: return mandelBoxDistanceKernelAVX2();
+	case SIMD_AVX512: return mandelBoxDistanceKernelAVX512();
+	default: return nullptr;
+	}
+}
+
+/// <summary>
+/// Picks the widest instruction set that has a kernel for the batch distance estimation.
+/// </summary>
+/// <returns>The instruction set.</returns>
+static SimdIsa bestDistanceIsa()
+{
+	for (int32_t i = SIMD_ISA_COUNT - 1; i > SIMD_SCALAR; i--)
+	{
+		if (mandelBoxGetDistanceKernel(SimdIsa(i)) != nullptr)
+			return SimdIsa(i);
+	}
+	return SIMD_SCALAR;
+}
+
+static SimdIsa distance_isa = bestDistanceIsa();
+static DistanceBatchKernel distance_kernel = mandelBoxGetDistanceKernel(distance_isa);
+
+/// <summary>
+/// Selects the instruction set used by mandelBoxGetDistanceBatch. Not thread safe, call it before rendering.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>True if a kernel is available for the instruction set. The selection stays unchanged otherwise.</returns>
+bool mandelBoxSetSimdIsa(const SimdIsa& isa)
+{
+	DistanceBatchKernel kernel = mandelBoxGetDistanceKernel(isa);
+	if (kernel == nullptr)
+		return false;
+
+	distance_isa = isa;
+	distance_kernel = kernel;
+	return true;
+}
+
+/// <summary>
+/// Returns the instruction set used by mandelBoxGetDistanceBatch.
+/// </summary>
+/// <returns>The instruction set.</returns>
+SimdIsa mandelBoxGetSimdIsa()
+{
+	return distance_isa;
+}
+
+/// <summary>
+/// Returns the distance to the closest point of the mandelbox fractal for a batch of positions. Uses the widest SIMD kernel available, unless another one was chosen via mandelBoxSetSimdIsa.
+/// </summary>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances for each position.</param>
+/// <param name="count">The number of positions.</param>
+void mandelBoxGetDistanceBatch(const float* x, const float* y, const float* z, float* distance, const uint32_t& count)
+{
+	distance_kernel(x, y, z, distance, count);
+}
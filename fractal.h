@@ -9,10 +9,48 @@
 
 #include <stdint.h>
 #include "defines.h"
+#include "simd.h"
 
-const uint32_t fractal_iterations = 25; //those values seem good enough for our purposes. You dont wanna go too high, as calculatiosn would increase
 const uint32_t trap_iterations = 5;
 
+struct MandelboxParameters
+{
+	uint32_t iterations;
+	float folding_limit;
+	float min_radius_sq;
+	float fixed_radius_sq;
+	float scale; //must be positive
+	float bailout; //escape radius that stops the iterations early. 0 disables it
+};
+
+//original mandelbox parameters. 25 iterations seem good enough for our purposes. You dont wanna go too high, as calculatiosn would increase
+const MandelboxParameters mandelbox_original = { 25, 1.0f, 0.25f, 1.0f, 2.0f, 0.0f };
+
+void mandelBoxSetParameters(const MandelboxParameters& params);
+
+const MandelboxParameters& mandelBoxGetParameters();
+
+bool mandelBoxIsSpecialized();
+
+float mandelBoxGetBoundingHalfSize(const float& surface_distance);
+
 float mandelBoxGetDistance(const float3& pos);
 
-float3 mandelboxGetColor(const float3& pos);
\ No newline at end of file
+float mandelBoxGetDistanceGeneric(const float3& pos);
+
+float mandelBoxGetDistanceGradient(const float3& pos, float3& gradient);
+
+float3 mandelboxGetColor(const float3& pos);
+
+//batch evaluation of the distance estimator with the positions given in SoA layout
+typedef void(*DistanceBatchKernel)(const float* x, const float* y, const float* z, float* distance, const uint32_t& count);
+
+void mandelBoxGetDistanceBatch(const float* x, const float* y, const float* z, float* distance, const uint32_t& count);
+
+void mandelBoxGetDistanceBatchScalar(const float* x, const float* y, const float* z, float* distance, const uint32_t& count);
+
+DistanceBatchKernel mandelBoxGetDistanceKernel(const SimdIsa& isa);
+
+bool mandelBoxSetSimdIsa(const SimdIsa& isa);
+
+SimdIsa mandelBoxGetSimdIsa();
\ No newline at end of file
@@ -0,0 +1,161 @@
+/**
+ * Contains the AVX2 kernel of fractal_simd.h.
+ * Evaluates eight positions at once
+ */
+
+#include "fractal_simd.h"
+#include "stats.h"
+#include <limits>
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include <immintrin.h>
+
+/// <summary>
+/// Returns the distance to the mandelbox fractal for eight positions. The folds are done via masks, so every lane executes the same instructions. Lanes whose orbit escaped keep their estimate, the loop ends once all of them escaped.
+/// </summary>
+/// <param name="ox">The x coordinates.</param>
+/// <param name="oy">The y coordinates.</param>
+/// <param name="oz">The z coordinates.</param>
+/// <param name="params">The mandelbox parameters.</param>
+/// <param name="bailout">The bailout terms.</param>
+/// <param name="iterations">[OUT] The iterations each lane actually needed.</param>
+/// <returns>The eight distances.</returns>
+static inline __m256 distance8(const __m256& ox, const __m256& oy, const __m256& oz, const MandelboxParameters& params, const MandelboxBailout& bailout, __m256& iterations)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 limit = _mm256_set1_ps(params.folding_limit);
+	const __m256 neg_limit = _mm256_set1_ps(-params.folding_limit);
+	const __m256 min_radius_sq = _mm256_set1_ps(params.min_radius_sq);
+	const __m256 fixed_radius_sq = _mm256_set1_ps(params.fixed_radius_sq);
+	const __m256 inner_factor = _mm256_set1_ps(params.fixed_radius_sq / params.min_radius_sq);
+	const __m256 scale = _mm256_set1_ps(params.scale);
+	const __m256 abs_mask = _mm256_set1_ps(-0.0f);
+
+	//bailout terms. See escapedDistance in fractal.cpp
+	const bool use_bailout = bailout.radius_sq < std::numeric_limits<float>::infinity();
+	const __m256 bailout_sq = _mm256_set1_ps(bailout.radius_sq);
+	const __m256 dr_growth = _mm256_set1_ps(bailout.dr_growth);
+	const __m256 offset_length = _mm256_sqrt_ps(_mm256_fmadd_ps(ox, ox, _mm256_fmadd_ps(oy, oy, _mm256_mul_ps(oz, oz))));
+	const __m256 shrink = _mm256_fmadd_ps(offset_length, _mm256_set1_ps(bailout.offset_factor), _mm256_set1_ps(bailout.fold_shrink));
+	const __m256 min_escape_length = _mm256_mul_ps(shrink, two);
+
+	__m256 px = ox;
+	__m256 py = oy;
+	__m256 pz = oz;
+	__m256 dr = one;
+	__m256 escaped = _mm256_setzero_ps();
+	__m256 escaped_distance = _mm256_setzero_ps();
+	iterations = _mm256_setzero_ps();
+
+	for (uint32_t i = 0; i < params.iterations; i++)
+	{
+		//box fold
+		px = _mm256_fmsub_ps(_mm256_min_ps(_mm256_max_ps(px, neg_limit), limit), two, px);
+		py = _mm256_fmsub_ps(_mm256_min_ps(_mm256_max_ps(py, neg_limit), limit), two, py);
+		pz = _mm256_fmsub_ps(_mm256_min_ps(_mm256_max_ps(pz, neg_limit), limit), two, pz);
+
+		//sphere fold: pick the factor per lane instead of branching
+		__m256 r2 = _mm256_fmadd_ps(px, px, _mm256_fmadd_ps(py, py, _mm256_mul_ps(pz, pz)));
+		__m256 inner = _mm256_cmp_ps(r2, min_radius_sq, _CMP_LT_OQ);
+		__m256 inversion = _mm256_cmp_ps(r2, fixed_radius_sq, _CMP_LT_OQ);
+		__m256 factor = _mm256_blendv_ps(one, _mm256_div_ps(fixed_radius_sq, r2), inversion);
+		factor = _mm256_blendv_ps(factor, inner_factor, inner);
+		px = _mm256_mul_ps(px, factor);
+		py = _mm256_mul_ps(py, factor);
+		pz = _mm256_mul_ps(pz, factor);
+		dr = _mm256_mul_ps(dr, factor);
+
+		//scale and offset
+		px = _mm256_fmadd_ps(px, scale, ox);
+		py = _mm256_fmadd_ps(py, scale, oy);
+		pz = _mm256_fmadd_ps(pz, scale, oz);
+		dr = _mm256_fmadd_ps(dr, scale, one);
+
+		iterations = _mm256_add_ps(iterations, _mm256_andnot_ps(escaped, one));
+
+		if (use_bailout) //freeze the estimate of lanes that escaped in this iteration
+		{
+			r2 = _mm256_fmadd_ps(px, px, _mm256_fmadd_ps(py, py, _mm256_mul_ps(pz, pz)));
+			__m256 r = _mm256_sqrt_ps(r2);
+			__m256 escaping = _mm256_andnot_ps(escaped, _mm256_and_ps(_mm256_cmp_ps(r2, bailout_sq, _CMP_GT_OQ), _mm256_cmp_ps(r, min_escape_length, _CMP_GE_OQ)));
+			if (_mm256_movemask_ps(escaping) != 0)
+			{
+				__m256 estimate = _mm256_div_ps(_mm256_sub_ps(r, shrink), _mm256_add_ps(_mm256_andnot_ps(abs_mask, dr), dr_growth));
+				escaped_distance = _mm256_blendv_ps(escaped_distance, estimate, escaping);
+				escaped = _mm256_or_ps(escaped, escaping);
+				if (_mm256_movemask_ps(escaped) == 0xff)
+					break;
+			}
+		}
+	}
+
+	__m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(px, px, _mm256_fmadd_ps(py, py, _mm256_mul_ps(pz, pz))));
+	__m256 abs_dr = _mm256_andnot_ps(abs_mask, dr);
+	return _mm256_blendv_ps(_mm256_div_ps(length, abs_dr), escaped_distance, escaped);
+}
+
+/// <summary>
+/// Batch distance estimation using AVX2 and FMA.
+/// </summary>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances for each position.</param>
+/// <param name="count">The number of positions.</param>
+static void mandelBoxGetDistanceAVX2(const float* x, const float* y, const float* z, float* distance, const uint32_t& count)
+{
+	const MandelboxParameters& params = mandelBoxGetParameters();
+	const MandelboxBailout& bailout = mandelBoxGetBailout();
+
+	__m256 iterations;
+	__m256 iteration_sum = _mm256_setzero_ps();
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(distance + i, distance8(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), params, bailout, iterations));
+		iteration_sum = _mm256_add_ps(iteration_sum, iterations);
+	}
+
+	if (i < count) //pad the remaining lanes with the origin
+	{
+		float tx[8] = { 0.0f }, ty[8] = { 0.0f }, tz[8] = { 0.0f }, td[8];
+		for (uint32_t j = 0; i + j < count; j++)
+		{
+			tx[j] = x[i + j];
+			ty[j] = y[i + j];
+			tz[j] = z[i + j];
+		}
+		_mm256_storeu_ps(td, distance8(_mm256_loadu_ps(tx), _mm256_loadu_ps(ty), _mm256_loadu_ps(tz), params, bailout, iterations));
+		for (uint32_t j = 0; i + j < count; j++)
+			distance[i + j] = td[j];
+		const __m256 tail = _mm256_cmp_ps(_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f), _mm256_set1_ps(float(count - i)), _CMP_LT_OQ); //the padding lanes do not count
+		iteration_sum = _mm256_add_ps(iteration_sum, _mm256_and_ps(tail, iterations));
+	}
+
+	if (stats_enabled)
+	{
+		float lane_iterations[8];
+		_mm256_storeu_ps(lane_iterations, iteration_sum);
+		float total_iterations = 0.0f;
+		for (uint32_t j = 0; j < 8; j++)
+			total_iterations += lane_iterations[j];
+		statsAdd(STAT_DE_EVALUATIONS, count);
+		statsAdd(STAT_DE_ITERATIONS, uint64_t(total_iterations));
+	}
+}
+
+DistanceBatchKernel mandelBoxDistanceKernelAVX2()
+{
+	return mandelBoxGetDistanceAVX2;
+}
+
+#else
+
+DistanceBatchKernel mandelBoxDistanceKernelAVX2()
+{
+	return nullptr;
+}
+
+#endif
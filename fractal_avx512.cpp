@@ -0,0 +1,151 @@
+/**
+ * Contains the AVX-512 kernel of fractal_simd.h.
+ * Evaluates sixteen positions at once
+ */
+
+#include "fractal_simd.h"
+#include "stats.h"
+#include <limits>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+/// <summary>
+/// Returns the distance to the mandelbox fractal for sixteen positions. The folds are done via mask registers, so every lane executes the same instructions. Lanes whose orbit escaped keep their estimate, the loop ends once all of them escaped.
+/// </summary>
+/// <param name="ox">The x coordinates.</param>
+/// <param name="oy">The y coordinates.</param>
+/// <param name="oz">The z coordinates.</param>
+/// <param name="params">The mandelbox parameters.</param>
+/// <param name="bailout">The bailout terms.</param>
+/// <param name="iterations">[OUT] The iterations each lane actually needed.</param>
+/// <returns>The sixteen distances.</returns>
+static inline __m512 distance16(const __m512& ox, const __m512& oy, const __m512& oz, const MandelboxParameters& params, const MandelboxBailout& bailout, __m512& iterations)
+{
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 two = _mm512_set1_ps(2.0f);
+	const __m512 limit = _mm512_set1_ps(params.folding_limit);
+	const __m512 neg_limit = _mm512_set1_ps(-params.folding_limit);
+	const __m512 min_radius_sq = _mm512_set1_ps(params.min_radius_sq);
+	const __m512 fixed_radius_sq = _mm512_set1_ps(params.fixed_radius_sq);
+	const __m512 inner_factor = _mm512_set1_ps(params.fixed_radius_sq / params.min_radius_sq);
+	const __m512 scale = _mm512_set1_ps(params.scale);
+
+	//bailout terms. See escapedDistance in fractal.cpp
+	const bool use_bailout = bailout.radius_sq < std::numeric_limits<float>::infinity();
+	const __m512 bailout_sq = _mm512_set1_ps(bailout.radius_sq);
+	const __m512 dr_growth = _mm512_set1_ps(bailout.dr_growth);
+	const __m512 offset_length = _mm512_sqrt_ps(_mm512_fmadd_ps(ox, ox, _mm512_fmadd_ps(oy, oy, _mm512_mul_ps(oz, oz))));
+	const __m512 shrink = _mm512_fmadd_ps(offset_length, _mm512_set1_ps(bailout.offset_factor), _mm512_set1_ps(bailout.fold_shrink));
+	const __m512 min_escape_length = _mm512_mul_ps(shrink, two);
+
+	__m512 px = ox;
+	__m512 py = oy;
+	__m512 pz = oz;
+	__m512 dr = one;
+	__mmask16 escaped = 0;
+	__m512 escaped_distance = _mm512_setzero_ps();
+	iterations = _mm512_setzero_ps();
+
+	for (uint32_t i = 0; i < params.iterations; i++)
+	{
+		//box fold
+		px = _mm512_fmsub_ps(_mm512_min_ps(_mm512_max_ps(px, neg_limit), limit), two, px);
+		py = _mm512_fmsub_ps(_mm512_min_ps(_mm512_max_ps(py, neg_limit), limit), two, py);
+		pz = _mm512_fmsub_ps(_mm512_min_ps(_mm512_max_ps(pz, neg_limit), limit), two, pz);
+
+		//sphere fold: pick the factor per lane instead of branching
+		__m512 r2 = _mm512_fmadd_ps(px, px, _mm512_fmadd_ps(py, py, _mm512_mul_ps(pz, pz)));
+		__mmask16 inner = _mm512_cmp_ps_mask(r2, min_radius_sq, _CMP_LT_OQ);
+		__mmask16 inversion = _mm512_cmp_ps_mask(r2, fixed_radius_sq, _CMP_LT_OQ);
+		__m512 factor = _mm512_mask_div_ps(one, inversion, fixed_radius_sq, r2);
+		factor = _mm512_mask_blend_ps(inner, factor, inner_factor);
+		px = _mm512_mul_ps(px, factor);
+		py = _mm512_mul_ps(py, factor);
+		pz = _mm512_mul_ps(pz, factor);
+		dr = _mm512_mul_ps(dr, factor);
+
+		//scale and offset
+		px = _mm512_fmadd_ps(px, scale, ox);
+		py = _mm512_fmadd_ps(py, scale, oy);
+		pz = _mm512_fmadd_ps(pz, scale, oz);
+		dr = _mm512_fmadd_ps(dr, scale, one);
+
+		iterations = _mm512_mask_add_ps(iterations, __mmask16(~escaped), iterations, one);
+
+		if (use_bailout) //freeze the estimate of lanes that escaped in this iteration
+		{
+			r2 = _mm512_fmadd_ps(px, px, _mm512_fmadd_ps(py, py, _mm512_mul_ps(pz, pz)));
+			__m512 r = _mm512_sqrt_ps(r2);
+			__mmask16 escaping = __mmask16(~escaped) & _mm512_cmp_ps_mask(r2, bailout_sq, _CMP_GT_OQ) & _mm512_cmp_ps_mask(r, min_escape_length, _CMP_GE_OQ);
+			if (escaping != 0)
+			{
+				__m512 estimate = _mm512_div_ps(_mm512_sub_ps(r, shrink), _mm512_add_ps(_mm512_abs_ps(dr), dr_growth));
+				escaped_distance = _mm512_mask_blend_ps(escaping, escaped_distance, estimate);
+				escaped |= escaping;
+				if (escaped == 0xffff)
+					break;
+			}
+		}
+	}
+
+	__m512 length = _mm512_sqrt_ps(_mm512_fmadd_ps(px, px, _mm512_fmadd_ps(py, py, _mm512_mul_ps(pz, pz))));
+	return _mm512_mask_blend_ps(escaped, _mm512_div_ps(length, _mm512_abs_ps(dr)), escaped_distance);
+}
+
+/// <summary>
+/// Batch distance estimation using AVX-512F. The tail is handled via masked loads and stores.
+/// </summary>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances for each position.</param>
+/// <param name="count">The number of positions.</param>
+static void mandelBoxGetDistanceAVX512(const float* x, const float* y, const float* z, float* distance, const uint32_t& count)
+{
+	const MandelboxParameters& params = mandelBoxGetParameters();
+	const MandelboxBailout& bailout = mandelBoxGetBailout();
+
+	__m512 iterations;
+	__m512 iteration_sum = _mm512_setzero_ps();
+
+	uint32_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(distance + i, distance16(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), _mm512_loadu_ps(z + i), params, bailout, iterations));
+		iteration_sum = _mm512_add_ps(iteration_sum, iterations);
+	}
+
+	if (i < count)
+	{
+		__mmask16 tail = __mmask16((1u << (count - i)) - 1u);
+		__m512 d = distance16(_mm512_maskz_loadu_ps(tail, x + i), _mm512_maskz_loadu_ps(tail, y + i), _mm512_maskz_loadu_ps(tail, z + i), params, bailout, iterations);
+		_mm512_mask_storeu_ps(distance + i, tail, d);
+		iteration_sum = _mm512_mask_add_ps(iteration_sum, tail, iteration_sum, iterations);
+	}
+
+	if (stats_enabled)
+	{
+		alignas(64) float lane_iterations[16];
+		_mm512_store_ps(lane_iterations, iteration_sum); //_mm512_reduce_add_ps trips -Wuninitialized in the headers of GCC 12
+		float total_iterations = 0.0f;
+		for (uint32_t j = 0; j < 16; j++)
+			total_iterations += lane_iterations[j];
+		statsAdd(STAT_DE_EVALUATIONS, count);
+		statsAdd(STAT_DE_ITERATIONS, uint64_t(total_iterations));
+	}
+}
+
+DistanceBatchKernel mandelBoxDistanceKernelAVX512()
+{
+	return mandelBoxGetDistanceAVX512;
+}
+
+#else
+
+DistanceBatchKernel mandelBoxDistanceKernelAVX512()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * Contains the SIMD kernels that evaluate the
+ * Mandelbox distance estimator for a batch of
+ * positions. Each kernel lives in its own
+ * translation unit so it can be compiled for
+ * its instruction set.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "fractal.h"
+
+//terms for stopping the iterations once the orbit escaped. See escapedDistance in fractal.cpp
+struct MandelboxBailout
+{
+	float radius_sq; //infinity if the bailout is disabled
+	float fold_shrink; //how much the box folds can still shrink |p|, relative to the scale
+	float offset_factor; //how much the offsets can still shrink |p|, relative to |offset|
+	float dr_growth; //how much dr can still grow, relative to the scale
+};
+
+const MandelboxBailout& mandelBoxGetBailout();
+
+//each getter returns nullptr if the compiler could not build the kernel for its instruction set
+DistanceBatchKernel mandelBoxDistanceKernelSSE();
+DistanceBatchKernel mandelBoxDistanceKernelAVX2();
+DistanceBatchKernel mandelBoxDistanceKernelAVX512();
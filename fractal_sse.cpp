@@ -0,0 +1,158 @@
+/**
+ * Contains the SSE4.1 kernel of fractal_simd.h.
+ * Evaluates four positions at once
+ */
+
+#include "fractal_simd.h"
+#include "stats.h"
+#include <limits>
+
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(__AVX__)))
+#include <smmintrin.h>
+
+/// <summary>
+/// Returns the distance to the mandelbox fractal for four positions. The folds are done via masks, so every lane executes the same instructions. Lanes whose orbit escaped keep their estimate, the loop ends once all of them escaped.
+/// </summary>
+/// <param name="ox">The x coordinates.</param>
+/// <param name="oy">The y coordinates.</param>
+/// <param name="oz">The z coordinates.</param>
+/// <param name="params">The mandelbox parameters.</param>
+/// <param name="bailout">The bailout terms.</param>
+/// <param name="iterations">[OUT] The iterations each lane actually needed.</param>
+/// <returns>The four distances.</returns>
+static inline __m128 distance4(const __m128& ox, const __m128& oy, const __m128& oz, const MandelboxParameters& params, const MandelboxBailout& bailout, __m128& iterations)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 limit = _mm_set1_ps(params.folding_limit);
+	const __m128 neg_limit = _mm_set1_ps(-params.folding_limit);
+	const __m128 min_radius_sq = _mm_set1_ps(params.min_radius_sq);
+	const __m128 fixed_radius_sq = _mm_set1_ps(params.fixed_radius_sq);
+	const __m128 inner_factor = _mm_set1_ps(params.fixed_radius_sq / params.min_radius_sq);
+	const __m128 scale = _mm_set1_ps(params.scale);
+	const __m128 abs_mask = _mm_set1_ps(-0.0f);
+
+	//bailout terms. See escapedDistance in fractal.cpp
+	const bool use_bailout = bailout.radius_sq < std::numeric_limits<float>::infinity();
+	const __m128 bailout_sq = _mm_set1_ps(bailout.radius_sq);
+	const __m128 dr_growth = _mm_set1_ps(bailout.dr_growth);
+	const __m128 offset_length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+	const __m128 shrink = _mm_add_ps(_mm_set1_ps(bailout.fold_shrink), _mm_mul_ps(offset_length, _mm_set1_ps(bailout.offset_factor)));
+	const __m128 min_escape_length = _mm_mul_ps(shrink, two);
+
+	__m128 px = ox;
+	__m128 py = oy;
+	__m128 pz = oz;
+	__m128 dr = one;
+	__m128 escaped = _mm_setzero_ps();
+	__m128 escaped_distance = _mm_setzero_ps();
+	iterations = _mm_setzero_ps();
+
+	for (uint32_t i = 0; i < params.iterations; i++)
+	{
+		//box fold
+		px = _mm_sub_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(px, neg_limit), limit), two), px);
+		py = _mm_sub_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(py, neg_limit), limit), two), py);
+		pz = _mm_sub_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(pz, neg_limit), limit), two), pz);
+
+		//sphere fold: pick the factor per lane instead of branching
+		__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+		__m128 inner = _mm_cmplt_ps(r2, min_radius_sq);
+		__m128 inversion = _mm_cmplt_ps(r2, fixed_radius_sq);
+		__m128 factor = _mm_blendv_ps(one, _mm_div_ps(fixed_radius_sq, r2), inversion);
+		factor = _mm_blendv_ps(factor, inner_factor, inner);
+		px = _mm_mul_ps(px, factor);
+		py = _mm_mul_ps(py, factor);
+		pz = _mm_mul_ps(pz, factor);
+		dr = _mm_mul_ps(dr, factor);
+
+		//scale and offset
+		px = _mm_add_ps(_mm_mul_ps(px, scale), ox);
+		py = _mm_add_ps(_mm_mul_ps(py, scale), oy);
+		pz = _mm_add_ps(_mm_mul_ps(pz, scale), oz);
+		dr = _mm_add_ps(_mm_mul_ps(dr, scale), one);
+
+		iterations = _mm_add_ps(iterations, _mm_andnot_ps(escaped, one));
+
+		if (use_bailout) //freeze the estimate of lanes that escaped in this iteration
+		{
+			r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+			__m128 r = _mm_sqrt_ps(r2);
+			__m128 escaping = _mm_andnot_ps(escaped, _mm_and_ps(_mm_cmpgt_ps(r2, bailout_sq), _mm_cmpge_ps(r, min_escape_length)));
+			if (_mm_movemask_ps(escaping) != 0)
+			{
+				__m128 estimate = _mm_div_ps(_mm_sub_ps(r, shrink), _mm_add_ps(_mm_andnot_ps(abs_mask, dr), dr_growth));
+				escaped_distance = _mm_blendv_ps(escaped_distance, estimate, escaping);
+				escaped = _mm_or_ps(escaped, escaping);
+				if (_mm_movemask_ps(escaped) == 0xf)
+					break;
+			}
+		}
+	}
+
+	__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz)));
+	__m128 abs_dr = _mm_andnot_ps(abs_mask, dr);
+	return _mm_blendv_ps(_mm_div_ps(length, abs_dr), escaped_distance, escaped);
+}
+
+/// <summary>
+/// Batch distance estimation using SSE4.1.
+/// </summary>
+/// <param name="x">The x coordinates of the positions.</param>
+/// <param name="y">The y coordinates of the positions.</param>
+/// <param name="z">The z coordinates of the positions.</param>
+/// <param name="distance">[OUT] The distances for each position.</param>
+/// <param name="count">The number of positions.</param>
+static void mandelBoxGetDistanceSSE(const float* x, const float* y, const float* z, float* distance, const uint32_t& count)
+{
+	const MandelboxParameters& params = mandelBoxGetParameters();
+	const MandelboxBailout& bailout = mandelBoxGetBailout();
+
+	__m128 iterations;
+	__m128 iteration_sum = _mm_setzero_ps();
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(distance + i, distance4(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i), params, bailout, iterations));
+		iteration_sum = _mm_add_ps(iteration_sum, iterations);
+	}
+
+	if (i < count) //pad the remaining lanes with the origin
+	{
+		float tx[4] = { 0.0f }, ty[4] = { 0.0f }, tz[4] = { 0.0f }, td[4];
+		for (uint32_t j = 0; i + j < count; j++)
+		{
+			tx[j] = x[i + j];
+			ty[j] = y[i + j];
+			tz[j] = z[i + j];
+		}
+		_mm_storeu_ps(td, distance4(_mm_loadu_ps(tx), _mm_loadu_ps(ty), _mm_loadu_ps(tz), params, bailout, iterations));
+		for (uint32_t j = 0; i + j < count; j++)
+			distance[i + j] = td[j];
+		const __m128 tail = _mm_cmplt_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_set1_ps(float(count - i))); //the padding lanes do not count
+		iteration_sum = _mm_add_ps(iteration_sum, _mm_and_ps(tail, iterations));
+	}
+
+	if (stats_enabled)
+	{
+		float lane_iterations[4];
+		_mm_storeu_ps(lane_iterations, iteration_sum);
+		statsAdd(STAT_DE_EVALUATIONS, count);
+		statsAdd(STAT_DE_ITERATIONS, uint64_t(lane_iterations[0] + lane_iterations[1] + lane_iterations[2] + lane_iterations[3]));
+	}
+}
+
+DistanceBatchKernel mandelBoxDistanceKernelSSE()
+{
+	return mandelBoxGetDistanceSSE;
+}
+
+#else
+
+DistanceBatchKernel mandelBoxDistanceKernelSSE()
+{
+	return nullptr;
+}
+
+#endif
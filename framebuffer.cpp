@@ -0,0 +1,235 @@
+/**
+ * Contains declerations for framebuffer.h
+ */
+
+#include "framebuffer.h"
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include "glm/gtc/packing.hpp"
+
+/// <summary>
+/// Packs a color into the shared exponent format of EXT_texture_shared_exponent. Negative values and NaN become 0, values beyond the range are clamped to the largest one.
+/// </summary>
+/// <param name="color">The color.</param>
+/// <returns>Red in bits 0-8, green in bits 9-17, blue in bits 18-26 and the exponent in bits 27-31.</returns>
+static uint32_t packRGB9E5(const float3& color)
+{
+	const int32_t mantissa_bits = 9;
+	const int32_t exponent_bias = 15;
+	const float max_value = 65408.0f; //(2^9 - 1) / 2^9 * 2^(31 - 15)
+
+	float rgb[3];
+	for (uint32_t c = 0; c < 3; c++)
+		rgb[c] = color[c] > 0.0f ? (color[c] < max_value ? color[c] : max_value) : 0.0f; //also catches NaN
+	const float max_rgb = glm::max(rgb[0], glm::max(rgb[1], rgb[2]));
+
+	int32_t exponent = -exponent_bias - 1; //floor(log2(max_rgb)), at least -16
+	if (max_rgb > 0.0f)
+	{
+		int32_t frexp_exponent = 0;
+		std::frexp(max_rgb, &frexp_exponent);
+		exponent = glm::max(exponent, frexp_exponent - 1);
+	}
+	int32_t shared = exponent + 1 + exponent_bias;
+
+	float step = std::ldexp(1.0f, shared - exponent_bias - mantissa_bits);
+	if (uint32_t(std::floor(max_rgb / step + 0.5f)) == (1u << mantissa_bits)) //rounding overflowed the mantissa
+	{
+		shared++;
+		step *= 2.0f;
+	}
+
+	uint32_t packed = uint32_t(shared) << 27;
+	for (uint32_t c = 0; c < 3; c++)
+		packed |= uint32_t(std::floor(rgb[c] / step + 0.5f)) << (c * mantissa_bits);
+	return packed;
+}
+
+/// <summary>
+/// Unpacks a color of the shared exponent format.
+/// </summary>
+/// <param name="packed">The packed color.</param>
+/// <returns>The color.</returns>
+static float3 unpackRGB9E5(const uint32_t& packed)
+{
+	const float step = std::ldexp(1.0f, int32_t(packed >> 27) - 15 - 9);
+	return float3(float(packed & 0x1ff), float((packed >> 9) & 0x1ff), float((packed >> 18) & 0x1ff)) * step;
+}
+
+/// <summary>
+/// Returns a human readable name of a frame format. Matches the names accepted by frameFormatFromName.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <returns>The name of the frame format.</returns>
+const char* frameFormatName(const FrameFormat& format)
+{
+	switch (format)
+	{
+	case FRAME_FORMAT_RGB32F: return "rgb32f";
+	case FRAME_FORMAT_RGB16F: return "rgb16f";
+	case FRAME_FORMAT_RGB9E5: return "rgb9e5";
+	case FRAME_FORMAT_RGBA8_SRGB: return "rgba8";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Parses the name of a frame format.
+/// </summary>
+/// <param name="name">The name as returned by frameFormatName.</param>
+/// <param name="format">[OUT] The parsed frame format.</param>
+/// <returns>True if the name was valid, false otherwise.</returns>
+bool frameFormatFromName(const char* name, FrameFormat& format)
+{
+	for (int32_t i = 0; i < FRAME_FORMAT_COUNT; i++)
+	{
+		if (strcmp(name, frameFormatName(FrameFormat(i))) == 0)
+		{
+			format = FrameFormat(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Returns the number of bytes a pixel needs in a frame format.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <returns>The size of a pixel.</returns>
+uint32_t frameFormatPixelSize(const FrameFormat& format)
+{
+	switch (format)
+	{
+	case FRAME_FORMAT_RGB16F: return 3 * sizeof(uint16_t);
+	case FRAME_FORMAT_RGB9E5: return sizeof(uint32_t);
+	case FRAME_FORMAT_RGBA8_SRGB: return 4;
+	default: return sizeof(float3);
+	}
+}
+
+/// <summary>
+/// Converts rendered pixels into a frame format. The renderer applies the gamma correction itself, so RGBA8 stores the colors as they are, clamped to 0..1, with an opaque alpha.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <param name="pixels">The rendered pixels.</param>
+/// <param name="count">The number of pixels.</param>
+/// <param name="target">[OUT] Room for count pixels of the frame format. Does not need to be aligned.</param>
+void frameEncodeRow(const FrameFormat& format, const float3* pixels, const uint32_t& count, void* target)
+{
+	uint8_t* bytes = static_cast<uint8_t*>(target);
+	switch (format)
+	{
+	case FRAME_FORMAT_RGB16F:
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint16_t half[3] = {glm::packHalf1x16(pixels[i].x), glm::packHalf1x16(pixels[i].y), glm::packHalf1x16(pixels[i].z)};
+			std::memcpy(bytes + i * sizeof(half), half, sizeof(half));
+		}
+		break;
+	case FRAME_FORMAT_RGB9E5:
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t packed = packRGB9E5(pixels[i]);
+			std::memcpy(bytes + i * sizeof(packed), &packed, sizeof(packed));
+		}
+		break;
+	case FRAME_FORMAT_RGBA8_SRGB:
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const float3 color = glm::clamp(pixels[i], 0.0f, 1.0f) * 255.0f + 0.5f;
+			bytes[i * 4 + 0] = uint8_t(color.x);
+			bytes[i * 4 + 1] = uint8_t(color.y);
+			bytes[i * 4 + 2] = uint8_t(color.z);
+			bytes[i * 4 + 3] = 255;
+		}
+		break;
+	default:
+		std::memcpy(target, pixels, count * sizeof(float3));
+		break;
+	}
+}
+
+/// <summary>
+/// Converts pixels of a frame format back to float triplets.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <param name="source">The pixels of the frame format. Do not need to be aligned.</param>
+/// <param name="count">The number of pixels.</param>
+/// <param name="pixels">[OUT] The converted pixels.</param>
+void frameDecodeRow(const FrameFormat& format, const void* source, const uint32_t& count, float3* pixels)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(source);
+	switch (format)
+	{
+	case FRAME_FORMAT_RGB16F:
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint16_t half[3];
+			std::memcpy(half, bytes + i * sizeof(half), sizeof(half));
+			pixels[i] = float3(glm::unpackHalf1x16(half[0]), glm::unpackHalf1x16(half[1]), glm::unpackHalf1x16(half[2]));
+		}
+		break;
+	case FRAME_FORMAT_RGB9E5:
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t packed = 0;
+			std::memcpy(&packed, bytes + i * sizeof(packed), sizeof(packed));
+			pixels[i] = unpackRGB9E5(packed);
+		}
+		break;
+	case FRAME_FORMAT_RGBA8_SRGB:
+		for (uint32_t i = 0; i < count; i++)
+			pixels[i] = float3(bytes[i * 4 + 0], bytes[i * 4 + 1], bytes[i * 4 + 2]) / 255.0f;
+		break;
+	default:
+		std::memcpy(static_cast<void*>(pixels), source, count * sizeof(float3)); //the source may be unaligned
+		break;
+	}
+}
+
+/// <summary>
+/// Returns if the file of a frame format stores the top row first. The frame buffer holds the lowest row first, as PFM does, but PAM readers draw the first row at the top.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <returns>True if the rows have to be written in the opposite order of the frame buffer.</returns>
+bool frameFileTopDown(const FrameFormat& format)
+{
+	return format == FRAME_FORMAT_RGBA8_SRGB;
+}
+
+/// <summary>
+/// Writes the header of the file a frame format is saved as. Its pixels follow right after it, row by row in the order of the frame buffer, or top down if frameFileTopDown says so.
+/// RGB32F is written as PFM. RGB16F and RGB9E5 use the same header with the magic PH or PE, RGBA8 is written as PAM. The scale of the PFM style headers is padded with zeros so the pixels start at a multiple of 4 bytes.
+/// </summary>
+/// <param name="format">The frame format.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="header">[OUT] The header, not terminated.</param>
+/// <param name="size">The size of header in bytes, 128 are always enough.</param>
+/// <returns>The length of the header, or a negative value if it did not fit.</returns>
+int32_t frameFileHeader(const FrameFormat& format, const uint32_t& width, const uint32_t& height, char* header, const size_t& size)
+{
+	char text[128];
+	int32_t length = -1;
+	if (format == FRAME_FORMAT_RGBA8_SRGB)
+	{
+		length = snprintf(text, sizeof(text), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+	}
+	else
+	{
+		const char* magic = format == FRAME_FORMAT_RGB16F ? "PH" : (format == FRAME_FORMAT_RGB9E5 ? "PE" : "PF");
+		for (int32_t zeros = 1; zeros <= 4; zeros++)
+		{
+			length = snprintf(text, sizeof(text), "%s\n%u %u\n-1.%.*d\n", magic, width, height, zeros, 0); //negative scale, little endian
+			if (length % 4 == 0)
+				break;
+		}
+	}
+
+	if (length < 0 || size_t(length) > size)
+		return -1;
+	std::memcpy(header, text, length);
+	return length;
+}
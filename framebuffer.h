@@ -0,0 +1,36 @@
+/**
+ * Contains the storage formats of the frame
+ * buffer. Pixels are rendered in full float
+ * precision and converted when a tile is copied
+ * into the frame, compact formats need 2-3x less
+ * memory and disk bandwidth than float triplets
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "defines.h"
+
+enum FrameFormat
+{
+	FRAME_FORMAT_RGB32F = 0, //float triplets, written as PFM
+	FRAME_FORMAT_RGB16F, //half float triplets, written as PFM with half floats
+	FRAME_FORMAT_RGB9E5, //three 9 bit mantissas sharing a 5 bit exponent
+	FRAME_FORMAT_RGBA8_SRGB, //8 bits per channel of the gamma corrected color, written as PAM
+	FRAME_FORMAT_COUNT
+};
+
+const char* frameFormatName(const FrameFormat& format);
+
+bool frameFormatFromName(const char* name, FrameFormat& format);
+
+uint32_t frameFormatPixelSize(const FrameFormat& format);
+
+void frameEncodeRow(const FrameFormat& format, const float3* pixels, const uint32_t& count, void* target);
+
+void frameDecodeRow(const FrameFormat& format, const void* source, const uint32_t& count, float3* pixels);
+
+bool frameFileTopDown(const FrameFormat& format);
+
+int32_t frameFileHeader(const FrameFormat& format, const uint32_t& width, const uint32_t& height, char* header, const size_t& size);
@@ -7,11 +7,30 @@
 #include <stdio.h>
 #include <cstdlib>
 #include <vector>
+#include <cstring>
+#include <cmath>
+#include <utility>
 #include "defines.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGE_SSE2
+#endif
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define IMAGE_MMAP_POSIX
+#endif
+
 //use CImg just for saving a BMP file
 #define cimg_display 0
-#include "cimg\CImg.h"
+#include "cimg/CImg.h"
 
 /// <summary>
 /// Saves a buffer of float triplets to a file on the disk using the .PFM format. This function follows the definition of the PFM format, described by Paul Debevec at http://www.pauldebevec.com/Research/HDR/PFM/
@@ -29,39 +48,487 @@ bool saveFloatImagePFM(const char* filename, const float* img, const uint32_t& w
 	if (fs == nullptr)
 		return false;
 
-	chk = fprintf(fs, "PF\n");
-	if (chk <= 0)
+	char header[128];
+	chk = frameFileHeader(FRAME_FORMAT_RGB32F, width, height, header, sizeof(header)); //the same header as the streamed and mapped outputs
+	if (chk <= 0 || fwrite(header, 1, chk, fs) != size_t(chk))
+	{
+		fclose(fs);
 		return false;
+	}
 
-	chk = fprintf(fs, "%d %d\n", width, height);
-	if (chk <= 0)
+	size_t elements_to_write = size_t(3) * width * height;
+	size_t elements_written = fwrite(img, sizeof(float), elements_to_write, fs); //write the actual image bytes to the file
+	if (elements_written != elements_to_write)
+	{
+		fclose(fs);
 		return false;
+	}
 
-	chk = fprintf(fs, "-1.0\n");
-	if (chk <= 0)
+	chk = fclose(fs);
+	if (chk != 0)
 		return false;
 
-	size_t elements_to_write = 3 * width * height;
-	size_t elements_written = fwrite(img, sizeof(float), elements_to_write, fs); //write the actual image bytes to the file
+	return true;
+}
+
+/// <summary>
+/// Loads a PFM file of one (Pf) or three (PF) float channels. Big endian files, marked by a positive scale, are converted.
+/// </summary>
+/// <param name="filename">The filename/path.</param>
+/// <param name="width">[OUT] The width of the image.</param>
+/// <param name="height">[OUT] The height of the image.</param>
+/// <param name="channels">[OUT] The number of channels, 1 or 3.</param>
+/// <returns>The pixels, the lowest row first, allocated with malloc. nullptr if the file could not be read.</returns>
+float* loadFloatImagePFM(const char* filename, uint32_t& width, uint32_t& height, uint32_t& channels)
+{
+	FILE* fs = fopen(filename, "rb");
+	if (fs == nullptr)
+		return nullptr;
+
+	char magic[3] = {0};
+	float scale = 0.0f;
+	if (fscanf(fs, "%2s %u %u %f", magic, &width, &height, &scale) != 4 || fgetc(fs) == EOF || scale == 0.0f || (strcmp(magic, "PF") != 0 && strcmp(magic, "Pf") != 0))
+	{
+		fclose(fs);
+		return nullptr;
+	}
+	channels = magic[1] == 'F' ? 3 : 1;
+
+	const size_t elements_to_read = size_t(channels) * width * height;
+	float* img = (float*)std::malloc(elements_to_read * sizeof(float));
+	if (img == nullptr || fread(img, sizeof(float), elements_to_read, fs) != elements_to_read)
+	{
+		std::free(img);
+		fclose(fs);
+		return nullptr;
+	}
+	fclose(fs);
+
+	const uint32_t probe = 1;
+	const bool little_endian = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+	if ((scale < 0.0f) != little_endian) //the file was written with the other byte order
+	{
+		uint8_t* bytes = reinterpret_cast<uint8_t*>(img);
+		for (size_t i = 0; i < elements_to_read; i++)
+		{
+			std::swap(bytes[i * 4 + 0], bytes[i * 4 + 3]);
+			std::swap(bytes[i * 4 + 1], bytes[i * 4 + 2]);
+		}
+	}
+	return img;
+}
+
+/// <summary>
+/// Starts writing the file of a frame format, see frameFileHeader, whose rows are handed over in bands. Only writes the header. The rows are stored in the order of the frame buffer, for PFM from the bottom to the top, so the bands have to come in that order as well.
+/// </summary>
+/// <param name="stream">[OUT] The stream.</param>
+/// <param name="filename">The filename/path.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="format">The frame format of the rows.</param>
+/// <returns>True if the file was opened and the header written, false otherwise.</returns>
+bool frameStreamOpen(FrameStream& stream, const char* filename, const uint32_t& width, const uint32_t& height, const FrameFormat& format)
+{
+	stream.row_size = frameFormatPixelSize(format) * width;
+	stream.width = width;
+	stream.height = height;
+	stream.rows_written = 0;
+	stream.top_down = frameFileTopDown(format);
+	stream.file = fopen(filename, "wb");
+	if (stream.file == nullptr)
+		return false;
+
+	char header[128];
+	const int32_t header_size = frameFileHeader(format, width, height, header, sizeof(header));
+	stream.header_size = header_size;
+	if (header_size < 0 || fwrite(header, 1, header_size, stream.file) != size_t(header_size))
+	{
+		fclose(stream.file);
+		stream.file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Starts writing a PFM file of one or three float channels whose rows are handed over in bands, see frameStreamOpen. One channel files use the magic Pf of grayscale PFM.
+/// </summary>
+/// <param name="stream">[OUT] The stream.</param>
+/// <param name="filename">The filename/path.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="channels">1 or 3.</param>
+/// <returns>True if the file was opened and the header written, false otherwise.</returns>
+bool pfmStreamOpen(FrameStream& stream, const char* filename, const uint32_t& width, const uint32_t& height, const uint32_t& channels)
+{
+	stream.row_size = sizeof(float) * channels * width;
+	stream.width = width;
+	stream.height = height;
+	stream.rows_written = 0;
+	stream.header_size = 0;
+	stream.top_down = false;
+	stream.file = fopen(filename, "wb");
+	if (stream.file == nullptr)
+		return false;
+
+	if (fprintf(stream.file, "%s\n%u %u\n-1.0\n", channels == 1 ? "Pf" : "PF", width, height) <= 0)
+	{
+		fclose(stream.file);
+		stream.file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Appends rows of pixels to the file of a frame format. The rows always come lowest first, formats stored top down get every row placed from the end of the file.
+/// </summary>
+/// <param name="stream">[IN/OUT] The stream.</param>
+/// <param name="rows">The rows in the frame format the stream was opened with.</param>
+/// <param name="row_count">The number of rows.</param>
+/// <returns>True if the rows were written, false otherwise or if they exceed the height of the image.</returns>
+bool frameStreamWriteRows(FrameStream& stream, const void* rows, const uint32_t& row_count)
+{
+	if (stream.file == nullptr || stream.rows_written + row_count > stream.height)
+		return false;
+
+	if (stream.top_down)
+	{
+		for (uint32_t row = 0; row < row_count; row++)
+		{
+			const long offset = stream.header_size + long(stream.height - 1 - (stream.rows_written + row)) * long(stream.row_size);
+			if (fseek(stream.file, offset, SEEK_SET) != 0 || fwrite(static_cast<const uint8_t*>(rows) + size_t(stream.row_size) * row, 1, stream.row_size, stream.file) != stream.row_size)
+				return false;
+		}
+		stream.rows_written += row_count;
+		return true;
+	}
+
+	size_t elements_to_write = size_t(stream.row_size) * row_count;
+	size_t elements_written = fwrite(rows, 1, elements_to_write, stream.file);
 	if (elements_written != elements_to_write)
 		return false;
 
-	chk = fclose(fs);
-	if (chk != 0)
+	stream.rows_written += row_count;
+	return true;
+}
+
+/// <summary>
+/// Finishes the file of a frame format.
+/// </summary>
+/// <param name="stream">[IN/OUT] The stream.</param>
+/// <returns>True if all rows of the image were written and the file was closed successfully, false otherwise.</returns>
+bool frameStreamClose(FrameStream& stream)
+{
+	if (stream.file == nullptr)
 		return false;
 
+	int32_t chk = fclose(stream.file);
+	stream.file = nullptr;
+	return chk == 0 && stream.rows_written == stream.height;
+}
+
+/// <summary>
+/// Creates the file of a frame format, see frameFileHeader, at its final size and maps it into memory, so the pixels can be written in place. The header is written right away. The space of the file is reserved up front where the OS allows it, so running out of disk space does not surface as a crash while writing to the mapping.
+/// </summary>
+/// <param name="map">[OUT] The mapping.</param>
+/// <param name="filename">The filename/path.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="format">The frame format of the pixels.</param>
+/// <returns>True if the file was created and mapped, false otherwise or if the OS does not support it.</returns>
+bool frameMapOpen(FrameMapping& map, const char* filename, const uint32_t& width, const uint32_t& height, const FrameFormat& format)
+{
+	map.pixels = nullptr;
+	map.view = nullptr;
+
+	char header[128];
+	const int32_t header_size = frameFileHeader(format, width, height, header, sizeof(header));
+	if (header_size < 0)
+		return false;
+	map.row_size = size_t(frameFormatPixelSize(format)) * width;
+	map.height = height;
+	map.top_down = frameFileTopDown(format);
+	map.view_size = size_t(header_size) + map.row_size * height;
+
+#if defined(IMAGE_MMAP_POSIX)
+	int32_t fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	int32_t chk = EOPNOTSUPP;
+#if defined(__linux__)
+	chk = posix_fallocate(fd, 0, off_t(map.view_size));
+#endif
+	if (chk != 0 && chk != EOPNOTSUPP && chk != EINVAL) //e.g. ENOSPC. A sparse file would run out of space while the mapping is written
+	{
+		close(fd);
+		return false;
+	}
+	if (chk != 0 && ftruncate(fd, off_t(map.view_size)) != 0) //the file system can not reserve the space, at least size the file
+	{
+		close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, map.view_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+	map.file = fd;
+	map.mapping = 0;
+#elif defined(_WIN32)
+	HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	size.QuadPart = LONGLONG(map.view_size);
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(size.HighPart), size.LowPart, nullptr); //also sizes the file
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, map.view_size);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	map.file = intptr_t(file);
+	map.mapping = intptr_t(mapping);
+#else
+	return false;
+#endif
+
+	map.view = view;
+	std::memcpy(view, header, header_size);
+	map.pixels = static_cast<char*>(view) + header_size;
 	return true;
 }
 
 /// <summary>
-/// Saves a buffer of float triplets to a file on the disk using the BMP format via CImg library: http://cimg.eu/.
+/// Hands the mapped file over to the OS and closes it. The flush is only started, the OS writes the pages back in the background while the program goes on or ends. Formats stored top down get their rows flipped in place first.
+/// </summary>
+/// <param name="map">[IN/OUT] The mapping.</param>
+/// <returns>True if the file was closed successfully, false otherwise.</returns>
+bool frameMapClose(FrameMapping& map)
+{
+	if (map.view == nullptr)
+		return false;
+
+	if (map.top_down)
+	{
+		std::vector<uint8_t> row(map.row_size);
+		uint8_t* pixels = static_cast<uint8_t*>(map.pixels);
+		for (uint32_t y = 0; y < map.height / 2; y++)
+		{
+			uint8_t* lower = pixels + map.row_size * y;
+			uint8_t* upper = pixels + map.row_size * (map.height - 1 - y);
+			std::memcpy(row.data(), lower, map.row_size);
+			std::memcpy(lower, upper, map.row_size);
+			std::memcpy(upper, row.data(), map.row_size);
+		}
+	}
+
+	bool chk = true;
+#if defined(IMAGE_MMAP_POSIX)
+	chk = msync(map.view, map.view_size, MS_ASYNC) == 0 && chk;
+	chk = munmap(map.view, map.view_size) == 0 && chk;
+	chk = close(int32_t(map.file)) == 0 && chk;
+#elif defined(_WIN32)
+	chk = FlushViewOfFile(map.view, 0) != 0 && chk; //does not wait for the disk
+	chk = UnmapViewOfFile(map.view) != 0 && chk;
+	chk = CloseHandle(HANDLE(map.mapping)) != 0 && chk;
+	chk = CloseHandle(HANDLE(map.file)) != 0 && chk;
+#endif
+	map.view = nullptr;
+	map.pixels = nullptr;
+	return chk;
+}
+
+/// <summary>
+/// Finds the smallest and largest value of a buffer of floats.
+/// </summary>
+/// <param name="values">The values.</param>
+/// <param name="count">The number of values, at least 1.</param>
+/// <param name="minimum">[OUT] The smallest value.</param>
+/// <param name="maximum">[OUT] The largest value.</param>
+static void valueRange(const float* values, const size_t& count, float& minimum, float& maximum)
+{
+	minimum = values[0];
+	maximum = values[0];
+	size_t i = 0;
+#if defined(IMAGE_SSE2)
+	if (count >= 4)
+	{
+		__m128 lo = _mm_loadu_ps(values);
+		__m128 hi = lo;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 v = _mm_loadu_ps(values + i);
+			lo = _mm_min_ps(lo, v);
+			hi = _mm_max_ps(hi, v);
+		}
+		float lanes_lo[4];
+		float lanes_hi[4];
+		_mm_storeu_ps(lanes_lo, lo);
+		_mm_storeu_ps(lanes_hi, hi);
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			minimum = lanes_lo[lane] < minimum ? lanes_lo[lane] : minimum;
+			maximum = lanes_hi[lane] > maximum ? lanes_hi[lane] : maximum;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		minimum = values[i] < minimum ? values[i] : minimum;
+		maximum = values[i] > maximum ? values[i] : maximum;
+	}
+}
+
+/// <summary>
+/// Converts floats to bytes: (value - minimum) * scale + offset, clamped to 0..255 and rounded to the nearest integer.
+/// </summary>
+/// <param name="values">The values.</param>
+/// <param name="offsets">Added to every value after scaling, e.g. the dither thresholds.</param>
+/// <param name="count">The number of values.</param>
+/// <param name="minimum">Subtracted from every value.</param>
+/// <param name="scale">Factor of every value.</param>
+/// <param name="bytes">[OUT] The converted values.</param>
+static void floatsToBytes(const float* values, const float* offsets, const size_t& count, const float& minimum, const float& scale, uint8_t* bytes)
+{
+	size_t i = 0;
+#if defined(IMAGE_SSE2)
+	const __m128 min4 = _mm_set1_ps(minimum);
+	const __m128 scale4 = _mm_set1_ps(scale);
+	const __m128 zero4 = _mm_setzero_ps();
+	const __m128 max4 = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i quads[4];
+		for (uint32_t q = 0; q < 4; q++)
+		{
+			__m128 v = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + i + q * 4), min4), scale4);
+			v = _mm_add_ps(v, _mm_loadu_ps(offsets + i + q * 4));
+			v = _mm_min_ps(_mm_max_ps(v, zero4), max4);
+			quads[q] = _mm_cvtps_epi32(v); //rounds to nearest
+		}
+		const __m128i words_lo = _mm_packs_epi32(quads[0], quads[1]);
+		const __m128i words_hi = _mm_packs_epi32(quads[2], quads[3]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + i), _mm_packus_epi16(words_lo, words_hi));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float v = (values[i] - minimum) * scale + offsets[i];
+		v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+		bytes[i] = uint8_t(std::nearbyint(v));
+	}
+}
+
+/// <summary>
+/// Saves a buffer of float triplets to a file on the disk using the 24 bit BMP format. Like the CImg writer the values are normalized, the smallest one of the image maps to 0 and the largest to 255, and the first row of the buffer ends up at the top. The rows are converted and written one by one through a buffer of a single row, there is no copy of the image. Values are rounded to the nearest byte, optionally after adding a 4x4 ordered dither, which hides banding in smooth gradients.
+/// </summary>
+/// <param name="filename">The filename/path.</param>
+/// <param name="img">Pointer to the buffer containing the float triplets.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="dither">True to apply ordered dithering.</param>
+/// <returns>True if the file was saved successfully, false otherwise.</returns>
+bool saveFloatImageBMP(const char* filename, const float* img, const uint32_t& width, const uint32_t& height, const bool& dither)
+{
+	if (width == 0 || height == 0)
+		return false;
+
+	const uint32_t row_values = 3 * width;
+	const uint32_t row_bytes = (row_values + 3) / 4 * 4; //rows are padded to 4 bytes
+	const uint64_t file_size = 54 + uint64_t(row_bytes) * height;
+	if (file_size > 0xffffffffu)
+		return false;
+
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	valueRange(img, size_t(row_values) * height, minimum, maximum);
+	const float scale = maximum > minimum ? 255.0f / (maximum - minimum) : 0.0f;
+
+	uint8_t header[54] = {0};
+	const uint32_t fields[][2] = //offset and value of the little endian 32 bit fields
+	{
+		{0x02, uint32_t(file_size)},
+		{0x0A, 54}, //offset of the pixels
+		{0x0E, 40}, //size of the info header
+		{0x12, width},
+		{0x16, height}, //positive, the lowest row comes first
+		{0x22, uint32_t(file_size - 54)}, //size of the pixels
+		{0x26, 2835}, //72 dpi
+		{0x2A, 2835},
+	};
+	header[0] = 'B';
+	header[1] = 'M';
+	header[0x1A] = 1; //planes
+	header[0x1C] = 24; //bits per pixel
+	for (const auto& field : fields)
+	{
+		for (uint32_t b = 0; b < 4; b++)
+			header[field[0] + b] = uint8_t(field[1] >> (8 * b));
+	}
+
+	std::vector<uint8_t> row(row_bytes + 16, 0); //16 bytes of slack for the vectorized conversion
+	std::vector<float> offsets(row_values, 0.0f);
+
+	FILE* fs = fopen(filename, "wb");
+	if (fs == nullptr)
+		return false;
+	bool chk = fwrite(header, 1, sizeof(header), fs) == sizeof(header);
+
+	const uint8_t bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+	for (uint32_t i = 0; chk && i < height; i++)
+	{
+		const uint32_t y = height - 1 - i; //the bottom row of the file is the last one of the buffer
+		if (dither)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const float threshold = (bayer[y & 3][x & 3] + 0.5f) / 16.0f - 0.5f;
+				offsets[x * 3 + 0] = threshold;
+				offsets[x * 3 + 1] = threshold;
+				offsets[x * 3 + 2] = threshold;
+			}
+		}
+
+		floatsToBytes(img + size_t(y) * row_values, offsets.data(), row_values, minimum, scale, row.data());
+		for (uint32_t x = 0; x < width; x++) //RGB to BGR
+		{
+			const uint8_t r = row[x * 3 + 0];
+			row[x * 3 + 0] = row[x * 3 + 2];
+			row[x * 3 + 2] = r;
+		}
+		for (uint32_t b = row_values; b < row_bytes; b++)
+			row[b] = 0;
+
+		chk = fwrite(row.data(), 1, row_bytes, fs) == row_bytes;
+	}
+
+	chk = fclose(fs) == 0 && chk;
+	return chk;
+}
+
+/// <summary>
+/// Saves a buffer of float triplets to a file on the disk using the BMP format via CImg library: http://cimg.eu/. Kept as a fallback for saveFloatImageBMP, it needs a planar copy of the whole image.
 /// </summary>
 /// <param name="filename">The filename/path.</param>
 /// <param name="img">Pointer to the buffer containing the float triplets.</param>
 /// <param name="width">The width of the image.</param>
 /// <param name="height">The height of the image.</param>
 /// <returns>True if the file was saved successfully, false otherwise.</returns>
-bool saveFloatImageBMP(const char* filename, const float* img, const uint32_t& width, const uint32_t& height)
+bool saveFloatImageBMPCImg(const char* filename, const float* img, const uint32_t& width, const uint32_t& height)
 {
 	//we actually have to de-interleave the image, requireing further allocations. The CImg functionality was added later to provide a more common output format.
 	const size_t buffer_size = sizeof(float)*3*width*height;
@@ -88,7 +555,7 @@ bool saveFloatImageBMP(const char* filename, const float* img, const uint32_t& w
 	image.normalize(0.0f, 255.0f);
 	image.save_bmp(filename);
 
-	safe_delete(planar);
+	std::free(planar);
 
 	return true;
 }
\ No newline at end of file
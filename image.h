@@ -7,7 +7,48 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+#include "framebuffer.h"
+
+struct FrameMapping
+{
+	void* pixels; //the pixel region of the file, in the order of the frame buffer until it is closed
+	void* view; //the mapping of the whole file
+	size_t view_size;
+	size_t row_size; //bytes per row
+	uint32_t height;
+	bool top_down; //the rows are flipped into the order of the file when it is closed
+	intptr_t file; //file descriptor, or HANDLE on windows
+	intptr_t mapping; //HANDLE of the file mapping on windows, unused elsewhere
+};
+
+struct FrameStream
+{
+	FILE* file;
+	uint32_t row_size; //bytes per row
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows_written;
+	long header_size;
+	bool top_down; //the rows are handed over lowest first, but stored top down
+};
 
 bool saveFloatImagePFM(const char* filename, const float* img, const uint32_t& width, const uint32_t& height);
 
-bool saveFloatImageBMP(const char* filename, const float* img, const uint32_t& width, const uint32_t& height);
\ No newline at end of file
+float* loadFloatImagePFM(const char* filename, uint32_t& width, uint32_t& height, uint32_t& channels);
+
+bool saveFloatImageBMP(const char* filename, const float* img, const uint32_t& width, const uint32_t& height, const bool& dither);
+
+bool saveFloatImageBMPCImg(const char* filename, const float* img, const uint32_t& width, const uint32_t& height);
+
+bool frameStreamOpen(FrameStream& stream, const char* filename, const uint32_t& width, const uint32_t& height, const FrameFormat& format);
+
+bool pfmStreamOpen(FrameStream& stream, const char* filename, const uint32_t& width, const uint32_t& height, const uint32_t& channels);
+
+bool frameStreamWriteRows(FrameStream& stream, const void* rows, const uint32_t& row_count);
+
+bool frameStreamClose(FrameStream& stream);
+
+bool frameMapOpen(FrameMapping& map, const char* filename, const uint32_t& width, const uint32_t& height, const FrameFormat& format);
+
+bool frameMapClose(FrameMapping& map);
\ No newline at end of file
@@ -6,209 +6,192 @@
 
 #include <cstring>
 #include <iostream>
-#include <fstream>
+#include <chrono>
 #include <stdint.h>
 
 #include "glm/glm.hpp"
 #include "defines.h"
 #include "fractal.h"
-#include "brdf.h"
 #include "image.h"
+#include "stats.h"
+#include "pool.h"
+#include "renderer.h"
+#include "trace.h"
+#include "perf.h"
 
 //-----------------------------------------|
-// constants for ray tracing and the scene |
+// configuration of the command line tool, |
+// the renderer keeps its own in           |
+// renderer.h                              |
 //-----------------------------------------|
-const uint32_t max_iterations = 400;
-const float max_distance = 25.0f;
-const float ao_steps = 5.0f;
-const uint32_t normal_iterations = 5;
 
-const float3 light_dir = glm::normalize(float3(0.64, 0.57, 0.52)); //I choose those to be constant. For simplicity sake
-const float3 light_color = float3(1, 1, 1);
-
-//-----------------------------------------|
-// configuration variables for rendering.  |
-// those are the result of command line    |
-// paramters. However, I choose to put     |
-// some neat default values in ;)          |
-//-----------------------------------------|
-
-float3* image = nullptr;
-
-uint32_t width = 200;
-uint32_t height = 200;
-uint32_t pixel_count = width * height;
-
-float3 camera_pos(0, 0, -10);
-float3 camera_view(0, 0, 1);
-float3 camera_up(0, 1, 0);
-float3 camera_side(1, 0, 0);
-float fov = 0.3f * PI; //horizontal
-float tan_hori = glm::tan(fov);
-float tan_vert = glm::tan(fov);
-
-float ao_radius = 0.05f;
-
-//-----------------------------------------|
-// functions for ray tracing and image     |
-// generation in general. Here you find    |
-// everything that is not really tied to   |
-// the fractal itself. Meaning the mandel- |
-// box specific funtions can be replaced   |
-// to render another fractal.              |
-//-----------------------------------------|
+const char* reshade_source = nullptr; //output of an earlier run whose G-buffer is shaded again instead of rendering
+uint32_t print_stats = 0; //0 prints nothing, 1 a human readable summary, 2 JSON
+bool map_output = true; //render the output in place within a memory mapping of the file
+FrameMapping output_map;
+const char* trace_file = nullptr; //timeline of the threads in the trace event format of Chrome
+bool count_perf = false; //read the hardware performance counters of the threads while clearing and rendering
+uint64_t perf_raw_config = 0; //model specific event counted in addition, 0 for none
 
 /// <summary>
-/// Approximates the normal vector for the mandelbox fractal.
+/// Prints the performance counters of every thread and their sum for the phases they were read in.
 /// </summary>
-/// <param name="pos">The position on the fractal for which the normal should be approximated.</param>
-/// <returns>A normalized vector that represents the surface orientation.</returns>
-float3 approxNormal(const float3& pos)
+/// <param name="json">True to print a JSON member, false for a human readable summary.</param>
+void printPerf(const bool& json)
 {
-	float h = 2.0f * EPS;
-	float3 normal = float3(0, 0, 0);
-	float normal_length = 0.0f;
+	const StatPhase phases[] = { PHASE_CLEAR, PHASE_RENDER };
+	const uint32_t phase_count = sizeof(phases) / sizeof(phases[0]);
+	const uint32_t thread_count = glm::min(poolGetThreadCount(), perf_max_threads);
 
-	for (uint32_t i = 0; i<normal_iterations && normal_length < EPS; i++)
+	if (json)
+		std::cout << "\t\"perf\": {";
+	else
+		std::cout << "Performance counters:" << std::endl;
+	for (uint32_t p = 0; p < phase_count; p++)
 	{
-		normal.x = mandelBoxGetDistance(float3(pos.x + h, pos.y, pos.z)) - mandelBoxGetDistance(float3(pos.x - h, pos.y, pos.z));
-		normal.y = mandelBoxGetDistance(float3(pos.x, pos.y + h, pos.z)) - mandelBoxGetDistance(float3(pos.x, pos.y - h, pos.z));
-		normal.z = mandelBoxGetDistance(float3(pos.x, pos.y, pos.z + h)) - mandelBoxGetDistance(float3(pos.x, pos.y, pos.z - h));
+		PerfValues total;
+		bool counted = false;
+		if (json)
+			std::cout << (p > 0 ? ", " : "") << "\"" << statsPhaseName(phases[p]) << "\": [";
+		for (uint32_t thread = 0; thread < thread_count; thread++)
+		{
+			PerfValues values;
+			if (!perfPhaseGet(phases[p], thread, values))
+				continue;
+			for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+			{
+				total.valid[counter] = values.valid[counter] && (!counted || total.valid[counter]);
+				total.values[counter] = (counted ? total.values[counter] : 0) + values.values[counter];
+			}
 
-		normal_length = glm::length(normal);
-		h += EPS;
+			if (json)
+			{
+				std::cout << (counted ? ", " : "") << "{\"thread\": " << thread;
+				for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+				{
+					std::cout << ", \"" << perfCounterName(PerfCounter(counter)) << "\": ";
+					if (values.valid[counter])
+						std::cout << values.values[counter];
+					else
+						std::cout << "null";
+				}
+				std::cout << "}";
+			}
+			else
+			{
+				std::cout << "  " << statsPhaseName(phases[p]) << ", thread " << thread << ": " << perfDescribe(values, 0) << std::endl;
+			}
+			counted = true;
+		}
+		if (json)
+			std::cout << "]";
+		else if (counted)
+			std::cout << "  " << statsPhaseName(phases[p]) << ", all threads: " << perfDescribe(total, 0) << std::endl;
 	}
-	assert(normal_length>0.0f);
-
-	return normal / normal_length;
+	if (json)
+		std::cout << "}," << std::endl;
 }
 
-
 /// <summary>
-/// Approxes the ambient occlusion for the mandelbox fractal. Works with ao_radius to determin the area on which to check for occluders.
+/// Prints the statistics of the run: the threads, the time of every phase, the peak memory use, the performance counters if they were read, and the counters, with the distance evaluations split by where they were made. The orbit traps for the surface color are listed on their own, they are no distance evaluations.
 /// </summary>
-/// <param name="pos">The position on the fractal for which the AO should be approximated.</param>
-/// <param name="normal">The surface normal for pos.</param>
-/// <returns>A value from 0 up to 1 representaing the AO</returns>
-float approxAmbientOcclusion(const float3& pos, const float3& normal, const float& ao_distance)
+/// <param name="json">True to print JSON, false for a human readable summary.</param>
+/// <param name="total_seconds">The time the whole run took.</param>
+void printStats(const bool& json, const double& total_seconds)
 {
-	const float ao_offset = ao_distance / ao_steps;
-	float walked_dist = ao_offset; //we need to offset from the start since we are approximating the fractal via a distance threshold
-	for (float i = 0.0f; i < ao_steps; i += 1.0f) //simple ray marching
+	const uint64_t de_evaluations = statsGet(STAT_DE_EVALUATIONS);
+	const uint64_t de_iterations = statsGet(STAT_DE_ITERATIONS);
+	const uint64_t primary_rays = statsGet(STAT_PRIMARY_RAYS);
+	const double average_iterations = de_evaluations > 0 ? double(de_iterations) / double(de_evaluations) : 0.0;
+	const StatCounter de_sites[] = { STAT_MARCH_STEPS, STAT_BEAM_STEPS, STAT_NORMAL_EVALUATIONS, STAT_AO_EVALUATIONS };
+	const char* de_site_names[] = { "march", "beam", "normal", "ao" };
+	const uint32_t de_site_count = sizeof(de_sites) / sizeof(de_sites[0]);
+
+	if (json)
 	{
-		float3 test_pos = pos + normal * walked_dist; //march along the normal and test for the closest point of the fractal
-		walked_dist += mandelBoxGetDistance(test_pos); 
+		std::cout << "{" << std::endl;
+		std::cout << "\t\"threads\": " << poolGetThreadCount() << "," << std::endl;
+		std::cout << "\t\"backend\": \"" << poolBackendName() << "\"," << std::endl;
+		std::cout << "\t\"pinned\": " << (poolGetPinning() ? "true" : "false") << "," << std::endl;
+		std::cout << "\t\"seconds\": {\"total\": " << total_seconds;
+		for (uint32_t phase = 0; phase < PHASE_COUNT; phase++)
+			std::cout << ", \"" << statsPhaseName(StatPhase(phase)) << "\": " << statsPhaseGet(StatPhase(phase));
+		std::cout << "}," << std::endl;
+		std::cout << "\t\"peak_memory_bytes\": " << statsPeakMemory() << "," << std::endl;
+		std::cout << "\t\"de_evaluations\": " << de_evaluations << "," << std::endl;
+		std::cout << "\t\"de_evaluations_by_site\": {";
+		for (uint32_t site = 0; site < de_site_count; site++)
+			std::cout << (site > 0 ? ", " : "") << "\"" << de_site_names[site] << "\": " << statsGet(de_sites[site]);
+		std::cout << "}," << std::endl;
+		std::cout << "\t\"color_evaluations\": " << statsGet(STAT_COLOR_EVALUATIONS) << "," << std::endl;
+		std::cout << "\t\"average_de_iterations\": " << average_iterations << "," << std::endl;
+		if (perfEnabled())
+			printPerf(true);
+		std::cout << "\t\"counters\": {";
+		for (uint32_t counter = 0; counter < STAT_COUNTER_COUNT; counter++)
+			std::cout << (counter > 0 ? ", " : "") << "\"" << statsCounterName(StatCounter(counter)) << "\": " << statsGet(StatCounter(counter));
+		std::cout << "}" << std::endl;
+		std::cout << "}" << std::endl;
+		return;
 	}
-	return glm::min(1.0f,walked_dist / (ao_offset * (ao_steps + 1.0f))); //divide by the amount we could have idially traveled
+
+	std::cout << "Threads: " << poolGetThreadCount() << " (" << poolBackendName() << (poolGetPinning() ? ", pinned" : "") << ")" << std::endl;
+	std::cout << "Time: " << total_seconds * 1000.0 << " ms (";
+	for (uint32_t phase = 0; phase < PHASE_COUNT; phase++)
+		std::cout << (phase > 0 ? ", " : "") << statsPhaseName(StatPhase(phase)) << " " << statsPhaseGet(StatPhase(phase)) * 1000.0 << " ms";
+	std::cout << ")" << std::endl;
+	std::cout << "Peak memory: " << double(statsPeakMemory()) / (1024.0 * 1024.0) << " MiB" << std::endl;
+
+	std::cout << "DE evaluations: " << de_evaluations << " (";
+	for (uint32_t site = 0; site < de_site_count; site++)
+		std::cout << (site > 0 ? ", " : "") << de_site_names[site] << " " << statsGet(de_sites[site]);
+	std::cout << "), color evaluations: " << statsGet(STAT_COLOR_EVALUATIONS) << std::endl;
+	std::cout << "Average DE iterations: " << average_iterations << " of " << mandelBoxGetParameters().iterations << std::endl;
+
+	std::cout << "Primary hits: " << statsGet(STAT_PRIMARY_HITS) << " of " << primary_rays << std::endl;
+	uint64_t march_steps = statsGet(STAT_MARCH_STEPS);
+	std::cout << "March steps: " << march_steps << " (" << (primary_rays > 0 ? double(march_steps) / double(primary_rays) : 0.0) << " per primary ray)" << std::endl;
+	std::cout << "Beam steps: " << statsGet(STAT_BEAM_STEPS) << " (" << (primary_rays > 0 ? double(statsGet(STAT_BEAM_STEPS)) / double(primary_rays) : 0.0) << " per primary ray)" << std::endl;
+	std::cout << "Oversteps recovered: " << statsGet(STAT_OVERSTEPS) << std::endl;
+	std::cout << "Rays culled by bounds: " << statsGet(STAT_RAYS_CULLED) << " of " << primary_rays << ", clipped: " << statsGet(STAT_RAYS_CLIPPED) << std::endl;
+	if (perfEnabled())
+		printPerf(false);
 }
 
 /// <summary>
-/// Ray traces the mandelbox. Termination via max_iterations.
+/// Ends a run of rendering or reshading the same way: writes the trace, reports the result and prints the statistics.
 /// </summary>
-/// <param name="ray_pos">Startin position.</param>
-/// <param name="ray_dir">Ray direction.</param>
-/// <param name="pixel_radius">The inital pixels radius. Used to terminate the marching</param>
-/// <param name="distance">[OUT] The distance of the ray marching until termination.</param>
-/// <returns>true if the fractal was hit, false otherwise</returns>
-bool rayTrace(float3& ray_pos, const float3& ray_dir, const float& pixel_radius, float& distance)
+/// <param name="rendered">False if the image could not be rendered.</param>
+/// <param name="written">False if the output could not be written.</param>
+/// <param name="run_start">When the run started.</param>
+/// <returns>The exit code of the program.</returns>
+int32_t finishRun(const bool& rendered, const bool& written, const std::chrono::steady_clock::time_point& run_start)
 {
-	distance = 0.0f;
-	
-	for (uint32_t it = 0; it < max_iterations; it++) //do the ray tracing
+	if (trace_file != nullptr && !traceWrite(trace_file))
 	{
-		float d = mandelBoxGetDistance(ray_pos);
-
-		distance += d;
-		ray_pos += ray_dir * d;
-
-		if (d < (pixel_radius * distance)) //terminate at sub-pixel width; radius is taken within the pixel and therefore not accurate, but good enough; this also does the AA but also introduces banding
-		{
-			return true;
-		}
-
-		if (distance > max_distance) //terminate at max distance
-		{
-			return false;
-		}
+		*message_stream << "Could not write the trace to " << trace_file << "!" << std::endl;
 	}
-
-	return false;
-}
-
-/// <summary>
-/// On render thread represents on pixel. Writes a color into the pixels location within the buffer, if the ray tracing hits the fractal.
-/// </summary>
-/// <param name="pixel_num">The number of the pixel to render.</param>
-/// <param name="x">The x of the pixel to render.</param>
-/// <param name="y">The y of the pixel to render.</param>
-void renderThread(const uint32_t& pixel_num, const uint32_t& x, const uint32_t& y)
-{
-	//some const inits used to setup the tracing
-	const float u = float(x) / float(width - 1);
-	const float v = float(y) / float(height - 1);
-	const float s = u * 2.0f - 1.0f;
-	const float t = v * 2.0f - 1.0f;
-
-	float3& pixel = image[pixel_num];
-
-	//calculated the ray direction
-	float3 ray_dir = camera_view + camera_side * tan_hori * s + camera_up * tan_vert * t;
-	ray_dir = glm::normalize(ray_dir);
-
-	float pixel_radius = tan_hori / (float(width) * 0.5f) * 0.5f; //0.5 half side; 0.5 radius
-
-	//init and do the ray tracing
-	float distance = 0.0f;
-	float3 fractal_pos = camera_pos;
-
-	bool res = rayTrace(fractal_pos, ray_dir, pixel_radius, distance);
-
-	if (res) //we actually hit the fractal
+	if (!rendered)
 	{
-		//gather attributes of the hit
-		float3 surface_color = mandelboxGetColor(fractal_pos);
-		float3 surface_normal = approxNormal(fractal_pos);
-		float surface_ao = approxAmbientOcclusion(fractal_pos, surface_normal, ao_radius); //for simplicity we use a global radius. This can be tuned to adjust for the 'zoom' in the given camera setup
-
-		//just some random values for our fractal regarding the shading
-		float3 ambient_color = surface_color * surface_ao * 0.2f;
-		float3 diffuse_color = surface_color * 0.4f;
-		float3 specular_color = float3(1,1,1) * 0.4f;
-
-		//do the lighting and write to our image buffer
-		float3 blinn_phong = brdfBlinnPhong(surface_normal, ambient_color, diffuse_color, specular_color, -ray_dir, light_dir, light_color);
-
-		//SRGB correction
-		pixel = glm::pow(blinn_phong, float3(inverse_gamma, inverse_gamma, inverse_gamma));
+		perfDisable();
+		return EXIT_FAILURE;
+	}
+	if (written == false)
+	{
+		*message_stream << "Writing the output file went wrong!" << std::endl;
+		perfDisable();
+		return EXIT_FAILURE;
 	}
-}
-
-//-----------------------------------------|
-// Main                                    |
-//-----------------------------------------|
 
-/// <summary>
-/// Checks if str starts with the char sequence pre
-/// </summary>
-/// <param name="pre">The char sequence to check for.</param>
-/// <param name="str">The string which may or may not contain pre.</param>
-/// <returns>True if str starts with the sequence pre. False otherwise</returns>
-bool startsWith(const char *pre, const char *str) {
-	size_t len_pre = strlen(pre);
-	size_t len_str = strlen(str);
-	return len_str < len_pre ? false : strncmp(pre, str, len_pre) == 0;
-}
+	if (print_stats != 2) //keeps the JSON alone on stdout
+		*message_stream << "Finished Rendering!" << std::endl;
 
-/// <summary>
-/// Checks if str ends with the char sequence post
-/// </summary>
-/// <param name="post">The char sequence to check for.</param>
-/// <param name="str">The string which may or may not contain post.</param>
-/// <returns>True if str ends with the sequence pre. False otherwise</returns>
-bool endsWith(const char *post, const char *str) {
-	size_t len_post = strlen(post);
-	size_t len_str = strlen(str);
-	return len_str < len_post ? false : strncmp(post, str + (len_str - len_post), len_post) == 0;
+	if (print_stats > 0)
+	{
+		printStats(print_stats == 2, std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count());
+	}
+	perfDisable();
+	return EXIT_SUCCESS;
 }
 
 /// <summary>
@@ -221,9 +204,18 @@ int32_t main(int32_t argc, char** argv)
 {
 	if(argc<2) 
 	{
-		std::cout << "You must at least define the name of the output file!" << std::endl;
+		*message_stream << "You must at least define the name of the output file!" << std::endl;
 		return EXIT_FAILURE;
 	}
+	const std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point phase_start = run_start;
+
+	MandelboxParameters fractal_params = mandelbox_original;
+	for (int32_t argn = 2; argn < argc; argn++) //the notices of the parsing already have to stay off stdout if it carries the JSON statistics
+	{
+		if (strcmp(argv[argn], "stats:json") == 0)
+			message_stream = &std::cerr;
+	}
 
 	//read command line
 	for (int32_t argn = 2; argn < argc; argn++)
@@ -250,35 +242,286 @@ int32_t main(int32_t argc, char** argv)
 		}
 		else if (startsWith("cam:", arg))
 		{
-			if (strcmp("front", arg + 4) == 0)
+			rendererSetCamera(arg + 4);
+		}
+		else if (startsWith("fov:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 4, "%f", &tmp);
+			if (res == 1)
 			{
-				camera_pos = float3(10, 0, 2);
-				camera_view = float3(-1, 0, 0);
-				camera_up = float3(0, 1, 0);
-				camera_side = float3(0, 0, -1);
+				fov = glm::clamp(PI * tmp / 180.0f, PI * 0.523599f, PI * 0.666666f) * 0.5f; //from 30 to 120 degrees and we want half the fov for our calculations
 			}
-			else if (strcmp("edge", arg + 4) == 0)
+		}
+		else if (startsWith("bailout:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 8, "%f", &tmp);
+			if (res == 1)
 			{
-				camera_pos = float3(5.15f, 6.15f, -7.65f);
-				camera_view = glm::normalize(float3(-1.0f, -1.0f, 1.0f));
-				camera_side = glm::normalize(glm::cross(camera_view, float3(0, -1, 0)));
-				camera_up = glm::normalize(glm::cross(camera_view, camera_side));
+				fractal_params.bailout = glm::max(tmp, 0.0f);
 			}
-			else if (strcmp("back", arg + 4) == 0)
+		}
+		else if (startsWith("normal:", arg))
+		{
+			if (strcmp("analytic", arg + 7) == 0)
+			{
+				normal_mode = NORMAL_ANALYTIC;
+			}
+			else if (strcmp("fd", arg + 7) == 0)
 			{
-				camera_pos = float3(-3.75, 0, +7.25);
-				camera_view = float3(0, 0, -1);
-				camera_up = glm::normalize(float3(0.25f, 1.0f, 0.0f));
-				camera_side = glm::normalize(glm::cross(camera_up, camera_view));
+				normal_mode = NORMAL_FINITE_DIFFERENCE;
 			}
 		}
-		else if (startsWith("fov:", arg))
+		else if (startsWith("bounds:", arg))
 		{
-			float tmp = 0;
-			int32_t res = sscanf(arg + 4, "%f", &tmp);
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 7, "%u", &tmp);
 			if (res == 1)
 			{
-				fov = glm::clamp(PI * tmp / 180.0f, PI * 0.523599f, PI * 0.666666f) * 0.5f; //from 30 to 120 degrees and we want half the fov for our calculations
+				bounds_mode = BoundsMode(glm::min(tmp, uint32_t(BOUNDS_ENTER)));
+			}
+		}
+		else if (startsWith("relax:", arg))
+		{
+			float tmp = 0.0f;
+			int32_t res = sscanf(arg + 6, "%f", &tmp);
+			if (res == 1)
+			{
+				relaxation = glm::clamp(tmp, 1.0f, 1.95f);
+			}
+		}
+		else if (startsWith("threads:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 8, "%u", &tmp);
+			if (res == 1)
+			{
+				poolSetThreadCount(glm::min(tmp, 1024u));
+			}
+		}
+		else if (startsWith("pin:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 4, "%u", &tmp);
+			if (res == 1)
+			{
+				poolSetPinning(tmp != 0);
+			}
+		}
+		else if (startsWith("tile:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 5, "%u", &tmp);
+			if (res == 1)
+			{
+				tile_size = glm::clamp(tmp, 1u, 256u);
+			}
+		}
+		else if (startsWith("order:", arg))
+		{
+			if (!tileOrderFromName(arg + 6, tile_order))
+			{
+				*message_stream << "The tile order " << (arg + 6) << " is not available. Using " << tileOrderName(tile_order) << " instead." << std::endl;
+			}
+		}
+		else if (startsWith("beam:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 5, "%u", &tmp);
+			if (res == 1)
+			{
+				beam_size = tmp < 2 ? 0 : glm::min(tmp, 256u);
+			}
+		}
+		else if (startsWith("band:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 5, "%u", &tmp);
+			if (res == 1)
+			{
+				band_rows = tmp;
+			}
+		}
+		else if (startsWith("mmap:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 5, "%u", &tmp);
+			if (res == 1)
+			{
+				map_output = tmp > 0;
+			}
+		}
+		else if (startsWith("light:", arg))
+		{
+			float3 tmp;
+			int32_t res = sscanf(arg + 6, "%f,%f,%f", &tmp.x, &tmp.y, &tmp.z);
+			if (res == 3 && glm::length(tmp) > 0.0f)
+			{
+				light_dir = glm::normalize(tmp);
+			}
+		}
+		else if (startsWith("lightcolor:", arg))
+		{
+			float3 tmp;
+			int32_t res = sscanf(arg + 11, "%f,%f,%f", &tmp.x, &tmp.y, &tmp.z);
+			if (res == 3)
+			{
+				light_color = glm::max(tmp, float3(0, 0, 0));
+			}
+		}
+		else if (startsWith("ambient:", arg) || startsWith("diffuse:", arg) || startsWith("specular:", arg))
+		{
+			float tmp = 0.0f;
+			int32_t res = sscanf(strchr(arg, ':') + 1, "%f", &tmp);
+			if (res == 1)
+			{
+				const int32_t factor = arg[0] == 'a' ? 0 : (arg[0] == 'd' ? 1 : 2);
+				shading_factors[factor] = glm::max(tmp, 0.0f);
+			}
+		}
+		else if (startsWith("gamma:", arg))
+		{
+			float tmp = 0.0f;
+			int32_t res = sscanf(arg + 6, "%f", &tmp);
+			if (res == 1)
+			{
+				output_inverse_gamma = 1.0f / glm::clamp(tmp, 0.1f, 10.0f);
+			}
+		}
+		else if (startsWith("reshade:", arg))
+		{
+			reshade_source = arg + 8;
+		}
+		else if (startsWith("aov:", arg))
+		{
+			const char* name = arg + 4;
+			while (*name != '\0')
+			{
+				const char* end = strchr(name, ',');
+				const size_t length = end != nullptr ? size_t(end - name) : strlen(name);
+				bool found = length == 3 && strncmp(name, "all", 3) == 0;
+				for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+				{
+					if (found && length == 3 && strncmp(name, "all", 3) == 0)
+						aov_enabled[layer] = true;
+					else if (strlen(aov_layers[layer].name) == length && strncmp(name, aov_layers[layer].name, length) == 0)
+						aov_enabled[layer] = found = true;
+				}
+				if (!found)
+					*message_stream << "The AOV " << std::string(name, length) << " is not available." << std::endl;
+				name += end != nullptr ? length + 1 : length;
+			}
+		}
+		else if (startsWith("perf:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 5, "%u", &tmp);
+			if (res == 1)
+			{
+				count_perf = tmp != 0;
+			}
+		}
+		else if (startsWith("perfraw:", arg))
+		{
+			unsigned long long tmp = 0;
+			int32_t res = sscanf(arg + 8, "%llx", &tmp);
+			if (res == 1)
+			{
+				perf_raw_config = tmp;
+			}
+		}
+		else if (startsWith("trace:", arg))
+		{
+			trace_file = arg + 6;
+			traceEnable(true);
+		}
+		else if (startsWith("heatmap:", arg))
+		{
+			const char* channels[] = { "steps", "de", "ns" };
+			bool found = false;
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				if (strcmp(arg + 8, channels[channel]) == 0)
+				{
+					heatmap_channel = channel;
+					aov_enabled[AOV_COST] = found = true;
+				}
+			}
+			if (!found)
+				*message_stream << "The heatmap " << (arg + 8) << " is not available. Use steps, de or ns." << std::endl;
+		}
+		else if (startsWith("format:", arg))
+		{
+			if (!frameFormatFromName(arg + 7, frame_format))
+			{
+				*message_stream << "The frame format " << (arg + 7) << " is not available. Using " << frameFormatName(frame_format) << " instead." << std::endl;
+			}
+		}
+		else if (startsWith("dither:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 7, "%u", &tmp);
+			if (res == 1)
+			{
+				bmp_dither = tmp > 0;
+			}
+		}
+		else if (startsWith("bmp:", arg))
+		{
+			if (strcmp(arg + 4, "cimg") == 0 || strcmp(arg + 4, "native") == 0)
+				bmp_cimg = strcmp(arg + 4, "cimg") == 0;
+			else
+				*message_stream << "The bitmap writer " << (arg + 4) << " is not available. Using " << (bmp_cimg ? "cimg" : "native") << " instead." << std::endl;
+		}
+		else if (startsWith("progressive:", arg))
+		{
+			float tmp = 0.0f;
+			int32_t res = sscanf(arg + 12, "%f", &tmp);
+			if (res == 1)
+			{
+				progressive_interval = glm::max(tmp, 0.0f);
+			}
+		}
+		else if (startsWith("budget:", arg))
+		{
+			float tmp = 0.0f;
+			int32_t res = sscanf(arg + 7, "%f", &tmp);
+			if (res == 1)
+			{
+				budget_ms = glm::max(tmp, 0.0f);
+			}
+		}
+		else if (startsWith("stats:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 6, "%u", &tmp);
+			if (res == 1)
+			{
+				print_stats = glm::min(tmp, 1u);
+			}
+			else if (strcmp(arg + 6, "json") == 0)
+			{
+				print_stats = 2;
+			}
+		}
+		else if (startsWith("packet:", arg))
+		{
+			uint32_t tmp_w = 0;
+			uint32_t tmp_h = 0;
+			int32_t res = sscanf(arg + 7, "%ux%u", &tmp_w, &tmp_h);
+			if (res == 2 && tmp_w > 0 && tmp_h > 0 && tmp_w * tmp_h <= max_packet_lanes)
+			{
+				packet_width = tmp_w;
+				packet_height = tmp_h;
+			}
+		}
+		else if (startsWith("simd:", arg))
+		{
+			SimdIsa isa = SIMD_SCALAR;
+			if (!simdIsaFromName(arg + 5, isa) || !mandelBoxSetSimdIsa(isa))
+			{
+				*message_stream << "The instruction set " << (arg + 5) << " is not available. Using " << simdIsaName(mandelBoxGetSimdIsa()) << " instead." << std::endl;
 			}
 		}
 		else if (startsWith("ao:", arg))
@@ -290,51 +533,144 @@ int32_t main(int32_t argc, char** argv)
 				ao_radius = glm::clamp(tmp,EPS,4.0f);
 			}
 		}
+		else if (startsWith("iterations:", arg))
+		{
+			uint32_t tmp = 0;
+			int32_t res = sscanf(arg + 11, "%u", &tmp);
+			if (res == 1)
+			{
+				fractal_params.iterations = glm::clamp(tmp, 1u, 100u);
+			}
+		}
+		else if (startsWith("scale:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 6, "%f", &tmp);
+			if (res == 1)
+			{
+				fractal_params.scale = glm::clamp(tmp, 1.1f, 8.0f);
+			}
+		}
+		else if (startsWith("fold:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 5, "%f", &tmp);
+			if (res == 1)
+			{
+				fractal_params.folding_limit = glm::clamp(tmp, 0.1f, 4.0f);
+			}
+		}
+		else if (startsWith("minradiussq:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 12, "%f", &tmp);
+			if (res == 1)
+			{
+				fractal_params.min_radius_sq = glm::clamp(tmp, EPS, 16.0f);
+			}
+		}
+		else if (startsWith("fixedradiussq:", arg))
+		{
+			float tmp = 0;
+			int32_t res = sscanf(arg + 14, "%f", &tmp);
+			if (res == 1)
+			{
+				fractal_params.fixed_radius_sq = glm::clamp(tmp, EPS, 16.0f);
+			}
+		}
 	}
 
-	//process command line paramters
-	pixel_count = width * height;
-	float screen_ratio = float(height) / float(width);
-	tan_hori = glm::tan(fov);
-	tan_vert = tan_hori * screen_ratio;
-	
-	//buffer management
-	const size_t buffer_size = sizeof(float3)*width*height;
-	image = (float3*) std::malloc(buffer_size);
-	if (image == nullptr)
+	message_stream = print_stats == 2 ? &std::cerr : &std::cout; //a later stats: may have overridden the JSON
+	phase_start = statsPhaseEnd(PHASE_PARSE, phase_start);
+
+	if (count_perf)
 	{
-		std::cout << "Could not allocate the necessary memory for the image buffer!" << std::endl;
-		return EXIT_FAILURE;
+		if (perfEnable(perf_raw_config))
+			print_stats = glm::max(print_stats, 1u); //the counters are reported with the statistics
+		else
+			*message_stream << "Performance counters are not available. perf_event_open is Linux only and may be restricted by /proc/sys/kernel/perf_event_paranoid." << std::endl;
 	}
-	std::memset(image, 0, buffer_size);
+	statsEnable(print_stats > 0 || aov_enabled[AOV_COST]); //the cost layer reads the DE evaluations of the threads
 
-	//kick off the rendering
-	#pragma omp parallel for schedule(dynamic,1)
-	for (int32_t pixel_num = 0; pixel_num < pixel_count; pixel_num++) 
+	//process command line paramters
+	fractal_params.min_radius_sq = glm::min(fractal_params.min_radius_sq, fractal_params.fixed_radius_sq); //the inner radius must not exceed the fixed one
+	mandelBoxSetParameters(fractal_params);
+	rendererPrepare();
+	if (reshade_source != nullptr) //only the shading pass, which reports its own errors
 	{
-		uint32_t pn = uint32_t(pixel_num);
-		uint32_t x = pn % width;
-		uint32_t y = pn / width;
-
-		renderThread(pn, x, y);
+		return finishRun(reshadeImage(reshade_source, argv[1]), true, run_start);
+	}
+	band_rows = (band_rows + tile_size - 1) / tile_size * tile_size; //whole tiles per band, so bands render exactly like the whole frame
+	if (band_rows > 0 && endsWith(".bmp", argv[1]))
+	{
+		*message_stream << "Streaming in bands can not write bitmaps. Rendering the whole frame at once instead." << std::endl;
+		band_rows = 0;
+	}
+	if (band_rows > 0 && (progressive_interval > 0.0f || budget_ms > 0.0f))
+	{
+		*message_stream << "Progressive rendering and budgets need the whole frame. They are ignored while streaming in bands." << std::endl;
 	}
 
-	//write the image to the file and delete the buffer
-	bool chk = false;
-	
-	if(endsWith(".bmp",argv[1]))
-		chk = saveFloatImageBMP(argv[1], (float*)image, width, height);
-	else
-		chk = saveFloatImagePFM(argv[1], (float*)image, width, height);
-
-	safe_delete_a(image);
-
-	if (chk == false)
+	//buffer management. Streaming keeps one band of rows in memory, a mapped output needs no buffer at all, otherwise the whole frame is kept
+	const uint32_t image_rows = band_rows > 0 ? glm::min(band_rows, height) : height;
+	if (map_output && band_rows == 0 && progressive_interval == 0.0f && !endsWith(".bmp", argv[1])) //snapshots would rewrite the mapped file
+	{
+		image_mapped = frameMapOpen(output_map, argv[1], width, height, frame_format);
+		if (image_mapped)
+			image = static_cast<uint8_t*>(output_map.pixels);
+		else
+			*message_stream << "Could not map the output file. Rendering into memory instead." << std::endl;
+	}
+	if (!renderBuffersCreate(image_rows)) //the buffers are cleared by the render threads, see touchTileTask
 	{
-		std::cout << "Writing the output file went wrong!" << std::endl;
+		if (image_mapped)
+			frameMapClose(output_map);
 		return EXIT_FAILURE;
 	}
+	phase_start = statsPhaseEnd(PHASE_ALLOCATE, phase_start);
+
+	//kick off the rendering and write the image to the file. renderRows times the clearing and rendering itself
+	render_start = std::chrono::steady_clock::now();
+	bool rendered = true;
+	FrameStream aov_streams[AOV_COUNT];
+	bool chk = aovStreamsOpen(argv[1], aov_streams);
+	if (band_rows > 0)
+	{
+		FrameStream stream;
+		chk = frameStreamOpen(stream, argv[1], width, height, frame_format) && chk;
+		statsPhaseEnd(PHASE_WRITE, phase_start);
+		for (uint32_t y0 = 0; chk && rendered && y0 < height; y0 += image_rows) //the bands come lowest first like the rows of PFM, the stream places them top down for PAM
+		{
+			const uint32_t y1 = glm::min(y0 + image_rows, height);
+			image_y0 = y0;
+			rendered = renderRows(y0, y1, argv[1]);
+			phase_start = std::chrono::steady_clock::now();
+			chk = rendered && frameStreamWriteRows(stream, image, y1 - y0);
+			chk = chk && aovStreamsWriteRows(aov_streams, y1 - y0);
+			statsPhaseEnd(PHASE_WRITE, phase_start);
+		}
+		phase_start = std::chrono::steady_clock::now();
+		if (stream.file != nullptr)
+			chk = frameStreamClose(stream) && chk;
+	}
+	else
+	{
+		statsPhaseEnd(PHASE_WRITE, phase_start);
+		rendered = renderRows(0, height, argv[1]);
+		phase_start = std::chrono::steady_clock::now();
+		if (image_mapped) //the pixels are in the file already, the OS writes them back in the background
+			chk = frameMapClose(output_map) && chk;
+		else if (rendered)
+			chk = saveImage(argv[1], image) && chk;
+		chk = chk && rendered && aovStreamsWriteRows(aov_streams, height);
+	}
+	chk = aovStreamsClose(aov_streams) && chk;
+	if (chk && rendered && aov_enabled[AOV_COST])
+		chk = saveCostHeatmap(argv[1]);
+	statsPhaseEnd(PHASE_WRITE, phase_start);
+	poolShutdown();
 
-	std::cout << "Finished Rendering!" << std::endl;
-	return EXIT_SUCCESS;
+	renderBuffersDestroy();
+
+	return finishRun(rendered, chk, run_start);
 }
\ No newline at end of file
@@ -0,0 +1,330 @@
+/**
+ * Contains declerations for perf.h
+ */
+
+#include "perf.h"
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// The counters opened by one thread of the pool. perf_event_open counts the thread that opened them, so every thread opens its own.
+/// </summary>
+struct PerfThread
+{
+	int32_t fds[PERF_COUNTER_COUNT]; //-1 if the counter could not be opened
+	long owner; //kernel id of the thread the counters belong to, 0 if none are open
+	PerfValues phase_start;
+};
+
+static bool enabled = false;
+static uint64_t raw_event = 0; //0 leaves PERF_RAW closed
+static std::vector<PerfThread> threads;
+static std::vector<PerfValues> phase_totals[PHASE_COUNT]; //per thread
+static std::vector<bool> phase_counted[PHASE_COUNT]; //per thread, true once a phase ended on it
+
+#if defined(__linux__)
+
+/// <summary>
+/// Opens one counter for the calling thread, counting user space only, which needs the least privileges.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <returns>The file descriptor, -1 if the counter is not available.</returns>
+static int32_t openCounter(const PerfCounter& counter)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	switch (counter)
+	{
+	case PERF_CYCLES: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+	case PERF_INSTRUCTIONS: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+	case PERF_CACHE_REFERENCES: attr.config = PERF_COUNT_HW_CACHE_REFERENCES; break;
+	case PERF_CACHE_MISSES: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+	case PERF_BRANCHES: attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS; break;
+	case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+	case PERF_RAW:
+		if (raw_event == 0)
+			return -1;
+		attr.type = PERF_TYPE_RAW;
+		attr.config = raw_event;
+		break;
+	case PERF_TASK_CLOCK:
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.config = PERF_COUNT_SW_TASK_CLOCK;
+		break;
+	case PERF_CONTEXT_SWITCHES:
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+		break;
+	default:
+		return -1;
+	}
+	return int32_t(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)); //this thread, any cpu, no group
+}
+
+/// <summary>
+/// Closes the counters of a thread slot.
+/// </summary>
+/// <param name="thread">[IN/OUT] The slot.</param>
+static void closeCounters(PerfThread& thread)
+{
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+	{
+		if (thread.fds[counter] >= 0)
+			close(thread.fds[counter]);
+		thread.fds[counter] = -1;
+	}
+	thread.owner = 0;
+}
+
+#endif
+
+/// <summary>
+/// Starts counting. The counters of a thread are opened the first time it reads them. Not thread safe, call it before rendering.
+/// </summary>
+/// <param name="raw_config">Config of a model specific event counted as PERF_RAW, e.g. 0x20c7 for 256 bit packed single precision instructions on recent Intel cores. 0 leaves it out.</param>
+/// <returns>False if no counter at all can be opened, e.g. on other systems than Linux or when perf_event_paranoid forbids it.</returns>
+bool perfEnable(const uint64_t& raw_config)
+{
+	perfDisable();
+#if defined(__linux__)
+	raw_event = raw_config;
+	PerfThread closed;
+	std::memset(&closed, 0, sizeof(closed));
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+		closed.fds[counter] = -1;
+	threads.assign(perf_max_threads, closed);
+	for (uint32_t phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		phase_totals[phase].assign(perf_max_threads, closed.phase_start);
+		phase_counted[phase].assign(perf_max_threads, false);
+	}
+
+	enabled = true;
+	PerfValues test;
+	perfRead(0, test);
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+	{
+		if (threads[0].fds[counter] >= 0)
+			return true;
+	}
+	perfDisable();
+	return false;
+#else
+	(void)raw_config;
+	return false;
+#endif
+}
+
+/// <summary>
+/// Returns if the counters are read.
+/// </summary>
+/// <returns>True if perfEnable succeeded.</returns>
+bool perfEnabled()
+{
+	return enabled;
+}
+
+/// <summary>
+/// Closes all counters and drops the values of the phases. Not thread safe, call it after rendering.
+/// </summary>
+void perfDisable()
+{
+#if defined(__linux__)
+	for (size_t i = 0; i < threads.size(); i++)
+		closeCounters(threads[i]);
+#endif
+	threads.clear();
+	for (uint32_t phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		phase_totals[phase].clear();
+		phase_counted[phase].clear();
+	}
+	enabled = false;
+}
+
+/// <summary>
+/// Reads the counters of the calling thread, which opens them on first use. Threads may read concurrently, as long as no two of them use the same thread number at once. A slot taken over by another thread, e.g. after the pool was restarted, opens new counters that start at 0.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool. The main thread is 0.</param>
+/// <param name="values">[OUT] The counted values since the counters were opened.</param>
+/// <returns>False if counting is disabled or the thread number is too high.</returns>
+bool perfRead(const uint32_t& thread_index, PerfValues& values)
+{
+	std::memset(&values, 0, sizeof(values));
+	if (!enabled || thread_index >= perf_max_threads)
+		return false;
+
+#if defined(__linux__)
+	PerfThread& thread = threads[thread_index];
+	const long owner = long(syscall(SYS_gettid));
+	if (thread.owner != owner)
+	{
+		closeCounters(thread);
+		for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+			thread.fds[counter] = openCounter(PerfCounter(counter));
+		thread.owner = owner;
+	}
+
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+	{
+		uint64_t data[3] = {}; //value, time enabled, time running
+		if (thread.fds[counter] < 0 || read(thread.fds[counter], data, sizeof(data)) != ssize_t(sizeof(data)) || data[2] == 0)
+			continue;
+		values.values[counter] = data[2] < data[1] ? uint64_t(double(data[0]) * double(data[1]) / double(data[2])) : data[0]; //the kernel multiplexed the counter, extrapolate
+		values.valid[counter] = true;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// <summary>
+/// Calculates the counts between two reads.
+/// </summary>
+/// <param name="end">The later read.</param>
+/// <param name="start">The earlier read.</param>
+/// <param name="delta">[OUT] The difference. Only valid where both reads are.</param>
+void perfSubtract(const PerfValues& end, const PerfValues& start, PerfValues& delta)
+{
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+	{
+		delta.valid[counter] = end.valid[counter] && start.valid[counter] && end.values[counter] >= start.values[counter];
+		delta.values[counter] = delta.valid[counter] ? end.values[counter] - start.values[counter] : 0;
+	}
+}
+
+/// <summary>
+/// Notes the counters of the calling thread at the start of a phase.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool. The main thread is 0.</param>
+void perfPhaseBegin(const uint32_t& thread_index)
+{
+	if (enabled && thread_index < perf_max_threads)
+		perfRead(thread_index, threads[thread_index].phase_start);
+}
+
+/// <summary>
+/// Adds what the calling thread counted since perfPhaseBegin to a phase. A phase may be counted in several parts, e.g. once per band.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool. The main thread is 0.</param>
+/// <param name="phase">The phase.</param>
+void perfPhaseEnd(const uint32_t& thread_index, const StatPhase& phase)
+{
+	PerfValues end;
+	if (!perfRead(thread_index, end))
+		return;
+	PerfValues delta;
+	perfSubtract(end, threads[thread_index].phase_start, delta);
+
+	PerfValues& total = phase_totals[phase][thread_index];
+	for (uint32_t counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+	{
+		total.valid[counter] = delta.valid[counter] && (total.valid[counter] || !phase_counted[phase][thread_index]);
+		total.values[counter] += delta.values[counter];
+	}
+	phase_counted[phase][thread_index] = true;
+}
+
+/// <summary>
+/// Returns what a thread counted in a phase.
+/// </summary>
+/// <param name="phase">The phase.</param>
+/// <param name="thread_index">The number of the thread within the pool.</param>
+/// <param name="values">[OUT] The counted values.</param>
+/// <returns>False if the thread was not counted in the phase.</returns>
+bool perfPhaseGet(const StatPhase& phase, const uint32_t& thread_index, PerfValues& values)
+{
+	std::memset(&values, 0, sizeof(values));
+	if (!enabled || thread_index >= perf_max_threads || !phase_counted[phase][thread_index])
+		return false;
+	values = phase_totals[phase][thread_index];
+	return true;
+}
+
+/// <summary>
+/// Returns a human readable name of a counter.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <returns>The name.</returns>
+const char* perfCounterName(const PerfCounter& counter)
+{
+	switch (counter)
+	{
+	case PERF_CYCLES: return "cycles";
+	case PERF_INSTRUCTIONS: return "instructions";
+	case PERF_CACHE_REFERENCES: return "cache references";
+	case PERF_CACHE_MISSES: return "cache misses";
+	case PERF_BRANCHES: return "branches";
+	case PERF_BRANCH_MISSES: return "branch misses";
+	case PERF_RAW: return "raw event";
+	case PERF_TASK_CLOCK: return "task clock ns";
+	case PERF_CONTEXT_SWITCHES: return "context switches";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Describes counted values in a line: instructions per cycle, cache and branch miss rates, the raw event, the task clock and context switches. Counters that were not available are left out.
+/// </summary>
+/// <param name="values">The counted values.</param>
+/// <param name="calls">Number of calls the values were counted over, to add misses per call. 0 leaves them out.</param>
+/// <returns>The description.</returns>
+std::string perfDescribe(const PerfValues& values, const uint64_t& calls)
+{
+	std::string text;
+	char part[128];
+	const uint64_t* v = values.values;
+	if (values.valid[PERF_CYCLES] && values.valid[PERF_INSTRUCTIONS] && v[PERF_CYCLES] > 0)
+	{
+		snprintf(part, sizeof(part), "IPC %.2f (%.1fM cycles), ", double(v[PERF_INSTRUCTIONS]) / double(v[PERF_CYCLES]), double(v[PERF_CYCLES]) * 1e-6);
+		text += part;
+	}
+	if (values.valid[PERF_CACHE_REFERENCES] && values.valid[PERF_CACHE_MISSES] && v[PERF_CACHE_REFERENCES] > 0)
+	{
+		snprintf(part, sizeof(part), "cache misses %.2f%%, ", 100.0 * double(v[PERF_CACHE_MISSES]) / double(v[PERF_CACHE_REFERENCES]));
+		text += part;
+	}
+	if (values.valid[PERF_BRANCHES] && values.valid[PERF_BRANCH_MISSES] && v[PERF_BRANCHES] > 0)
+	{
+		snprintf(part, sizeof(part), "branch misses %.2f%%, ", 100.0 * double(v[PERF_BRANCH_MISSES]) / double(v[PERF_BRANCHES]));
+		text += part;
+		if (calls > 0)
+		{
+			snprintf(part, sizeof(part), "%.3f branch misses per call, ", double(v[PERF_BRANCH_MISSES]) / double(calls));
+			text += part;
+		}
+	}
+	if (values.valid[PERF_RAW])
+	{
+		snprintf(part, sizeof(part), "raw event %llu, ", (unsigned long long)v[PERF_RAW]);
+		text += part;
+	}
+	if (values.valid[PERF_TASK_CLOCK])
+	{
+		snprintf(part, sizeof(part), "task clock %.3f ms, ", double(v[PERF_TASK_CLOCK]) * 1e-6);
+		text += part;
+	}
+	if (values.valid[PERF_CONTEXT_SWITCHES])
+	{
+		snprintf(part, sizeof(part), "%llu context switches, ", (unsigned long long)v[PERF_CONTEXT_SWITCHES]);
+		text += part;
+	}
+	if (text.empty())
+		return "no counters available";
+	text.resize(text.size() - 2);
+	return text;
+}
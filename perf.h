@@ -0,0 +1,56 @@
+/**
+ * Contains hardware performance counters read
+ * via perf_event_open on Linux: cycles,
+ * instructions, cache and branch misses and an
+ * optional raw event, e.g. for vector
+ * instructions. Counted per thread and phase.
+ * Elsewhere every counter is unavailable
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include "stats.h"
+
+const uint32_t perf_max_threads = 1024; //threads with a higher number are not counted
+
+enum PerfCounter
+{
+	PERF_CYCLES = 0,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_REFERENCES,
+	PERF_CACHE_MISSES,
+	PERF_BRANCHES,
+	PERF_BRANCH_MISSES,
+	PERF_RAW, //a model specific event given by its raw config, e.g. retired vector instructions
+	PERF_TASK_CLOCK, //nanoseconds the thread ran, a software event that also works without a PMU
+	PERF_CONTEXT_SWITCHES,
+	PERF_COUNTER_COUNT
+};
+
+struct PerfValues
+{
+	uint64_t values[PERF_COUNTER_COUNT]; //scaled up when the kernel multiplexed the counters
+	bool valid[PERF_COUNTER_COUNT]; //false if the counter could not be opened
+};
+
+bool perfEnable(const uint64_t& raw_config);
+
+bool perfEnabled();
+
+void perfDisable();
+
+bool perfRead(const uint32_t& thread_index, PerfValues& values);
+
+void perfSubtract(const PerfValues& end, const PerfValues& start, PerfValues& delta);
+
+void perfPhaseBegin(const uint32_t& thread_index);
+
+void perfPhaseEnd(const uint32_t& thread_index, const StatPhase& phase);
+
+bool perfPhaseGet(const StatPhase& phase, const uint32_t& thread_index, PerfValues& values);
+
+const char* perfCounterName(const PerfCounter& counter);
+
+std::string perfDescribe(const PerfValues& values, const uint64_t& calls);
@@ -0,0 +1,432 @@
+/**
+ * Contains declerations for pool.h
+ */
+
+#include "pool.h"
+#include "trace.h"
+#include <vector>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+static uint32_t thread_count = 0; //0 until the first use, then the number of hardware threads unless set
+static bool pinning = false;
+static std::vector<uint32_t> cpus; //the cpus the process may run on, in the order threads are pinned to them
+static bool pinned_before = false; //a thread was pinned, so threads that outlive the pinning have to be released
+#if defined(__linux__)
+static cpu_set_t allowed_cpus; //the mask the threads had before any was pinned
+#elif defined(_WIN32)
+static DWORD_PTR allowed_cpus = 0;
+#endif
+
+/// <summary>
+/// Collects the cpus the process may run on and keeps their mask, so pinned threads can be released again. Has to happen before the first thread is pinned, afterwards the mask of the main thread only holds one cpu.
+/// </summary>
+static void collectCpus()
+{
+	if (!cpus.empty())
+		return;
+
+#if defined(__linux__)
+	CPU_ZERO(&allowed_cpus);
+	if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) == 0)
+	{
+		for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &allowed_cpus))
+				cpus.push_back(cpu);
+		}
+	}
+#elif defined(_WIN32)
+	DWORD_PTR process_mask = 0;
+	DWORD_PTR system_mask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+	{
+		for (uint32_t cpu = 0; cpu < sizeof(DWORD_PTR) * 8; cpu++)
+		{
+			if (process_mask & (DWORD_PTR(1) << cpu))
+				cpus.push_back(cpu);
+		}
+		allowed_cpus = process_mask;
+	}
+#endif
+}
+
+/// <summary>
+/// Pins the calling thread to one cpu. Threads are spread over the cpus in the order the OS numbers them, which fills one socket before the next on most systems. Does nothing where pinning is not supported.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool.</param>
+static void pinThread(const uint32_t& thread_index)
+{
+	if (cpus.empty())
+		return;
+	const uint32_t cpu = cpus[thread_index % cpus.size()];
+
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+#endif
+	pinned_before = true;
+}
+
+/// <summary>
+/// Lets the calling thread run on all cpus of the process again, as before it was pinned. Threads inherit the mask of the thread that creates them, so the main thread has to be released before it starts new threads or goes on with its own work.
+/// </summary>
+static void unpinThread()
+{
+	if (cpus.empty())
+		return;
+
+#if defined(__linux__)
+	pthread_setaffinity_np(pthread_self(), sizeof(allowed_cpus), &allowed_cpus);
+#elif defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), allowed_cpus);
+#endif
+}
+
+/// <summary>
+/// The tasks of one thread. The owner takes them from the front, thieves from the back.
+/// </summary>
+struct Worker
+{
+	std::mutex mutex;
+	std::deque<uint32_t> tasks;
+};
+
+/// <summary>
+/// Hands every worker one contiguous range of the tasks, in order. Calls with the same task and worker count map every task to the same worker.
+/// </summary>
+/// <param name="workers">The workers, their deques have to be empty.</param>
+/// <param name="task_count">The number of tasks.</param>
+static void splitTasks(std::vector<std::unique_ptr<Worker>>& workers, const uint32_t& task_count)
+{
+	const uint64_t worker_count = workers.size();
+	for (uint64_t i = 0; i < worker_count; i++)
+	{
+		Worker& worker = *workers[i];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		for (uint32_t t = uint32_t(task_count * i / worker_count); t < uint32_t(task_count * (i + 1) / worker_count); t++)
+			worker.tasks.push_back(t);
+	}
+}
+
+/// <summary>
+/// Runs tasks until the own deque is empty and, if allowed, there is nothing left to steal either.
+/// </summary>
+/// <param name="workers">The workers of all threads.</param>
+/// <param name="thread_index">The number of the calling thread.</param>
+/// <param name="task">The function that runs a task.</param>
+/// <param name="data">Handed to every task.</param>
+/// <param name="steal">True to take tasks from the back of other workers once the own deque is empty.</param>
+static void runTasks(std::vector<std::unique_ptr<Worker>>& workers, const uint32_t& thread_index, PoolTask task, void* data, const bool& steal)
+{
+	const uint32_t worker_count = uint32_t(workers.size());
+	Worker& own = *workers[thread_index];
+
+	while (true)
+	{
+		uint32_t next = 0;
+		bool found = false;
+		{
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				next = own.tasks.front();
+				own.tasks.pop_front();
+				found = true;
+			}
+		}
+
+		for (uint32_t offset = 1; !found && steal && offset < worker_count; offset++) //look for work at the neighbours first
+		{
+			Worker& victim = *workers[(thread_index + offset) % worker_count];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				next = victim.tasks.back();
+				victim.tasks.pop_back();
+				found = true;
+			}
+		}
+
+		if (!found)
+			return;
+		task(next, thread_index, data);
+	}
+}
+
+#if defined(_OPENMP)
+
+static std::vector<std::unique_ptr<Worker>> team_workers; //one per thread of the current OpenMP team
+
+#else
+
+/// <summary>
+/// The threads of the pool and the job they currently run. The main thread takes part as thread 0.
+/// </summary>
+struct PoolState
+{
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	uint64_t generation = 0; //counts the jobs, threads wait for it to change
+	uint32_t running = 0; //threads that did not finish the current job yet
+	bool quit = false;
+	PoolTask task = nullptr;
+	void* data = nullptr;
+	bool steal = false;
+	bool traced = false; //the threads note when they started and finished the job
+	std::vector<std::chrono::steady_clock::time_point> started;
+	std::vector<std::chrono::steady_clock::time_point> finished;
+
+	~PoolState()
+	{
+		poolShutdown();
+	}
+};
+
+static PoolState pool;
+
+/// <summary>
+/// The loop of a pool thread. Waits for a job, runs it and reports back.
+/// </summary>
+/// <param name="thread_index">The number of the thread.</param>
+static void workerLoop(const uint32_t thread_index)
+{
+	if (pinning)
+		pinThread(thread_index);
+
+	uint64_t seen_generation = 0;
+	while (true)
+	{
+		bool traced = false;
+		{
+			std::unique_lock<std::mutex> lock(pool.mutex);
+			pool.start.wait(lock, [&] { return pool.quit || pool.generation != seen_generation; });
+			if (pool.quit)
+				return;
+			seen_generation = pool.generation;
+			traced = pool.traced;
+		}
+
+		if (traced)
+			pool.started[thread_index] = std::chrono::steady_clock::now();
+		runTasks(pool.workers, thread_index, pool.task, pool.data, pool.steal);
+		if (traced)
+			pool.finished[thread_index] = std::chrono::steady_clock::now();
+
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		if (--pool.running == 0)
+			pool.done.notify_one();
+	}
+}
+
+/// <summary>
+/// Starts the threads of the pool if they are not running yet.
+/// </summary>
+static void startThreads()
+{
+	if (!pool.workers.empty())
+		return;
+
+	pool.quit = false;
+	pool.generation = 0;
+	for (uint32_t i = 0; i < thread_count; i++)
+		pool.workers.emplace_back(new Worker());
+	for (uint32_t i = 1; i < thread_count; i++)
+		pool.threads.emplace_back(workerLoop, i);
+}
+
+#endif
+
+/// <summary>
+/// Records for every thread of a job how long it took until it started working and how long it sat idle at the end, waiting for the other threads to finish.
+/// </summary>
+/// <param name="job_start">When the job was handed to the threads.</param>
+/// <param name="started">When each thread started working on it.</param>
+/// <param name="finished">When each thread ran out of tasks.</param>
+static void traceWaits(const std::chrono::steady_clock::time_point& job_start, const std::vector<std::chrono::steady_clock::time_point>& started, const std::vector<std::chrono::steady_clock::time_point>& finished)
+{
+	const std::chrono::steady_clock::time_point job_end = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < uint32_t(started.size()); i++)
+	{
+		traceEvent(i, "wait for work", "pool", job_start, started[i]);
+		traceEvent(i, "idle", "pool", finished[i], job_end);
+	}
+}
+
+/// <summary>
+/// Sets the number of threads the pool uses. Running threads are stopped and restarted with the next job. Not thread safe, call it between jobs.
+/// </summary>
+/// <param name="count">The number of threads. 0 uses one thread per hardware thread.</param>
+void poolSetThreadCount(const uint32_t& count)
+{
+	poolShutdown();
+	thread_count = count > 0 ? count : std::thread::hardware_concurrency();
+	if (thread_count == 0) //the hardware concurrency is unknown
+		thread_count = 1;
+}
+
+/// <summary>
+/// Returns the number of threads the pool uses. Thread numbers handed to tasks are below it.
+/// </summary>
+/// <returns>The number of threads.</returns>
+uint32_t poolGetThreadCount()
+{
+	if (thread_count == 0)
+		poolSetThreadCount(0);
+	return thread_count;
+}
+
+/// <summary>
+/// Enables or disables pinning every thread to its own cpu. Running threads are stopped and restarted with the next job. Not thread safe, call it between jobs.
+/// </summary>
+/// <param name="pin">True to pin the threads.</param>
+void poolSetPinning(const bool& pin)
+{
+	poolShutdown();
+	pinning = pin;
+}
+
+/// <summary>
+/// Returns if the threads are pinned to cpus.
+/// </summary>
+/// <returns>True if the threads are pinned.</returns>
+bool poolGetPinning()
+{
+	return pinning;
+}
+
+/// <summary>
+/// Runs tasks 0 to task_count - 1 on the pool and returns once all of them are done. The calling thread takes part as thread 0. The tasks are split into one contiguous range per thread, which every thread works through in order. Without stealing this split is all there is, so calls with the same task count map every task to the same thread. That lets a first pass touch the memory later passes write to. Both backends split and steal the same way, OpenMP only provides the threads.
+/// While a trace is recorded, the time every thread waits for the job to reach it and sits idle at the end is recorded as well, for both backends.
+/// </summary>
+/// <param name="task_count">The number of tasks.</param>
+/// <param name="task">The function that runs a task.</param>
+/// <param name="data">Handed to every task.</param>
+/// <param name="steal">True to let threads that ran out of tasks steal from the back of other threads ranges.</param>
+void poolRun(const uint32_t& task_count, PoolTask task, void* data, const bool& steal)
+{
+	const uint32_t count = poolGetThreadCount();
+	collectCpus();
+	const bool traced = traceEnabled();
+	const std::chrono::steady_clock::time_point job_start = traced ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+#if defined(_OPENMP)
+	std::vector<std::chrono::steady_clock::time_point> started(traced ? count : 0, job_start);
+	std::vector<std::chrono::steady_clock::time_point> finished(traced ? count : 0, job_start);
+	#pragma omp parallel num_threads(int32_t(count))
+	{
+		const uint32_t thread_index = uint32_t(omp_get_thread_num());
+		if (pinning)
+			pinThread(thread_index);
+		else if (pinned_before) //the threads of OpenMP live on after the pinning was turned off
+			unpinThread();
+		if (traced)
+			started[thread_index] = std::chrono::steady_clock::now();
+
+		#pragma omp single //the runtime may start fewer threads than asked for, so the ranges follow the team
+		{
+			team_workers.resize(uint32_t(omp_get_num_threads()));
+			for (std::unique_ptr<Worker>& worker : team_workers)
+			{
+				if (!worker)
+					worker.reset(new Worker());
+			}
+			splitTasks(team_workers, task_count);
+		}
+		runTasks(team_workers, thread_index, task, data, steal); //not a schedule of the runtime, which maps the tasks to other threads than the first touch did
+
+		if (traced)
+			finished[thread_index] = std::chrono::steady_clock::now();
+	}
+	if (pinning)
+		unpinThread(); //the main thread goes on with work of its own
+	if (traced)
+		traceWaits(job_start, started, finished);
+#else
+	startThreads();
+	if (pinning)
+		pinThread(0);
+
+	splitTasks(pool.workers, task_count);
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.task = task;
+		pool.data = data;
+		pool.steal = steal;
+		pool.traced = traced;
+		pool.started.assign(traced ? count : 0, job_start);
+		pool.finished.assign(traced ? count : 0, job_start);
+		pool.running = count - 1;
+		pool.generation++;
+	}
+	pool.start.notify_all();
+
+	if (traced)
+		pool.started[0] = std::chrono::steady_clock::now();
+	runTasks(pool.workers, 0, task, data, steal);
+	if (traced)
+		pool.finished[0] = std::chrono::steady_clock::now();
+
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.done.wait(lock, [] { return pool.running == 0; });
+	if (pinning)
+		unpinThread(); //the main thread goes on with work of its own and may start the threads of the next job
+	if (traced)
+		traceWaits(job_start, pool.started, pool.finished);
+#endif
+}
+
+/// <summary>
+/// Stops and joins the threads of the pool. They are started again by the next job. Call it before the program ends, so no thread outlives the data it uses.
+/// </summary>
+void poolShutdown()
+{
+#if !defined(_OPENMP)
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.quit = true;
+	}
+	pool.start.notify_all();
+	for (size_t i = 0; i < pool.threads.size(); i++)
+		pool.threads[i].join();
+	pool.threads.clear();
+	pool.workers.clear();
+#endif
+}
+
+/// <summary>
+/// Returns the name of the threading backend the pool was built with.
+/// </summary>
+/// <returns>The name of the backend.</returns>
+const char* poolBackendName()
+{
+#if defined(_OPENMP)
+	return "openmp";
+#else
+	return "work stealing";
+#endif
+}
@@ -0,0 +1,33 @@
+/**
+ * Contains the thread pool that runs the
+ * rendering. Every thread owns a deque of
+ * tasks and steals from the others once its
+ * own deque ran dry. Built with OpenMP the
+ * threads of the OpenMP runtime do the same
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/// <summary>
+/// A task of the pool.
+/// </summary>
+/// <param name="task">The number of the task.</param>
+/// <param name="thread_index">The number of the thread running it, below poolGetThreadCount.</param>
+/// <param name="data">The pointer handed to poolRun.</param>
+typedef void(*PoolTask)(const uint32_t& task, const uint32_t& thread_index, void* data);
+
+void poolSetThreadCount(const uint32_t& thread_count);
+
+uint32_t poolGetThreadCount();
+
+void poolSetPinning(const bool& pin);
+
+bool poolGetPinning();
+
+void poolRun(const uint32_t& task_count, PoolTask task, void* data, const bool& steal);
+
+void poolShutdown();
+
+const char* poolBackendName();
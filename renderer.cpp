@@ -0,0 +1,1622 @@
+/**
+ * Contains declerations for renderer.h
+ */
+
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <stdint.h>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cmath>
+
+#include "renderer.h"
+#include "fractal.h"
+#include "brdf.h"
+#include "stats.h"
+#include "pool.h"
+#include "trace.h"
+#include "perf.h"
+
+//-----------------------------------------|
+// constants for ray tracing and the scene |
+//-----------------------------------------|
+const float max_distance = 25.0f;
+const uint32_t normal_iterations = 5;
+
+
+//-----------------------------------------|
+// configuration variables for rendering.  |
+// those are the result of command line    |
+// paramters. However, I choose to put     |
+// some neat default values in ;)          |
+// See renderer.h                          |
+//-----------------------------------------|
+
+float3 light_dir = glm::normalize(float3(0.64, 0.57, 0.52)); //pointing towards the light
+float3 light_color = float3(1, 1, 1);
+float3 shading_factors = float3(0.2f, 0.4f, 0.4f); //ambient, diffuse and specular factor of the surface color
+float output_inverse_gamma = inverse_gamma;
+
+uint8_t* image = nullptr; //the whole frame, or the band of rows rendered at the moment, in frame_format
+uint32_t image_y0 = 0; //first row held by image
+FrameFormat frame_format = FRAME_FORMAT_RGB32F;
+uint32_t frame_pixel_size = sizeof(float3); //bytes per pixel of frame_format
+
+uint32_t width = 200;
+uint32_t height = 200;
+uint32_t pixel_count = width * height;
+
+float3 camera_pos(0, 0, -10);
+float3 camera_view(0, 0, 1);
+float3 camera_up(0, 1, 0);
+float3 camera_side(1, 0, 0);
+float fov = 0.3f * PI; //horizontal
+float tan_hori = glm::tan(fov);
+float tan_vert = glm::tan(fov);
+
+float ao_radius = 0.05f;
+float ao_steps = 5.0f; //0 disables the ambient occlusion
+uint32_t max_iterations = 400; //march steps until a ray gives up
+
+BoundsMode bounds_mode = BOUNDS_CLIP;
+float bounds_half_size = 0.0f; //every primary ray hit lies within [-bounds_half_size, bounds_half_size]^3
+
+NormalMode normal_mode = NORMAL_ANALYTIC;
+
+float relaxation = 1.0f; //step length factor of the sphere tracing. 1 disables the over-relaxation
+
+uint32_t tile_size = 16; //side length of the tiles the threads render
+TileOrder tile_order = TILE_ORDER_HILBERT;
+
+uint32_t beam_size = 0; //side length of the tiles for the beam marching. 0 disables it
+float* beam_distance = nullptr; //per pixel distance where the beam marching stopped
+
+uint32_t band_rows = 0; //rows rendered and written to the output at a time. 0 renders the whole frame at once
+bool image_mapped = false; //image points into a mapping of the output file instead of the heap
+
+const AovLayerInfo aov_layers[AOV_COUNT] = { {"depth", 1}, {"normal", 3}, {"ao", 1}, {"steps", 1}, {"trap", 3}, {"cost", 3} };
+bool aov_enabled[AOV_COUNT] = {};
+float* aov_buffers[AOV_COUNT] = {}; //per pixel values of the enabled layers, holding the same rows as image
+uint32_t heatmap_channel = 2; //channel of the cost layer the heatmap shows: steps, DE evaluations or nanoseconds
+
+bool bmp_dither = false; //ordered dithering when converting to 8 bits
+bool bmp_cimg = false; //write bitmaps via CImg instead of the own writer
+
+float progressive_interval = 0.0f; //seconds between snapshots of the progressive rendering. 0 renders everything in one pass
+float budget_ms = 0.0f; //time limit of the rendering. 0 disables it
+std::chrono::steady_clock::time_point render_start; //the budget counts from here
+
+uint32_t packet_width = 1; //1x1 disables packet marching
+uint32_t packet_height = 1;
+
+std::ostream* message_stream = &std::cout; //notices and progress of the run, stderr while stdout carries the JSON statistics
+
+//-----------------------------------------|
+// ray packets that are marched together   |
+//-----------------------------------------|
+
+const uint32_t max_packet_lanes = 16;
+
+struct RayPacket
+{
+	uint32_t lanes;
+	uint32_t x[max_packet_lanes]; //the pixel of each lane
+	uint32_t y[max_packet_lanes];
+	float3 pos[max_packet_lanes];
+	float3 dir[max_packet_lanes];
+	float distance[max_packet_lanes];
+	float end_distance[max_packet_lanes];
+	bool hit[max_packet_lanes];
+	uint32_t steps[max_packet_lanes]; //march steps until the lane terminated
+};
+
+//-----------------------------------------|
+// pixel subsets for progressive rendering |
+//-----------------------------------------|
+
+struct PixelLattice
+{
+	uint32_t x_offset; //pixels at offset + i * step, relative to the lower left of a tile
+	uint32_t y_offset;
+	uint32_t x_step;
+	uint32_t y_step;
+};
+
+const PixelLattice full_lattice = { 0, 0, 1, 1 };
+
+struct ProgressivePass
+{
+	PixelLattice lattice; //the pixels traced in this pass
+	uint32_t block_width; //afterwards every pixel is covered by the traced pixel at the lower left of its block
+	uint32_t block_height;
+};
+
+const uint32_t progressive_pass_count = 7;
+
+//-----------------------------------------|
+// quality levels the budget mode steps    |
+// down to when time runs short            |
+//-----------------------------------------|
+
+struct QualityLevel
+{
+	const char* description;
+	float ao_steps; //upper limits of the knobs
+	uint32_t max_iterations;
+	float relaxation; //lower limit
+};
+
+const uint32_t quality_level_count = 3;
+
+const QualityLevel quality_levels[quality_level_count] = //ordered by how little they change the image
+{
+	{ "ambient occlusion steps lowered to 2", 2.0f, 400, 1.0f },
+	{ "ambient occlusion disabled", 0.0f, 400, 1.0f },
+	{ "march steps limited to 100, over-relaxation 1.5", 0.0f, 100, 1.5f }
+};
+
+const ProgressivePass progressive_passes[progressive_pass_count] = //interlacing of Adam7 (PNG) on 8x8 blocks. Every pixel belongs to exactly one pass
+{
+	{ { 0, 0, 8, 8 }, 8, 8 },
+	{ { 4, 0, 8, 8 }, 4, 8 },
+	{ { 0, 4, 4, 8 }, 4, 4 },
+	{ { 2, 0, 4, 4 }, 2, 4 },
+	{ { 0, 2, 2, 4 }, 2, 2 },
+	{ { 1, 0, 2, 2 }, 1, 2 },
+	{ { 0, 1, 1, 2 }, 1, 1 }
+};
+
+//-----------------------------------------|
+// functions for ray tracing and image     |
+// generation in general. Here you find    |
+// everything that is not really tied to   |
+// the fractal itself. Meaning the mandel- |
+// box specific funtions can be replaced   |
+// to render another fractal.              |
+//-----------------------------------------|
+
+/// <summary>
+/// Returns the index of a pixel within image and beam_distance, which only hold the rows from image_y0 on.
+/// </summary>
+/// <param name="x">The x of the pixel.</param>
+/// <param name="y">The y of the pixel.</param>
+/// <returns>The index.</returns>
+size_t imageIndex(const uint32_t& x, const uint32_t& y)
+{
+	return size_t(y - image_y0) * width + x;
+}
+
+/// <summary>
+/// Approximates the normal vector for the mandelbox fractal via central differences of the distance estimator.
+/// </summary>
+/// <param name="pos">The position on the fractal for which the normal should be approximated.</param>
+/// <returns>A normalized vector that represents the surface orientation.</returns>
+float3 approxNormalFiniteDifference(const float3& pos)
+{
+	float h = 2.0f * EPS;
+	float3 normal = float3(0, 0, 0);
+	float normal_length = 0.0f;
+
+	for (uint32_t i = 0; i<normal_iterations && normal_length < EPS; i++)
+	{
+		normal.x = mandelBoxGetDistance(float3(pos.x + h, pos.y, pos.z)) - mandelBoxGetDistance(float3(pos.x - h, pos.y, pos.z));
+		normal.y = mandelBoxGetDistance(float3(pos.x, pos.y + h, pos.z)) - mandelBoxGetDistance(float3(pos.x, pos.y - h, pos.z));
+		normal.z = mandelBoxGetDistance(float3(pos.x, pos.y, pos.z + h)) - mandelBoxGetDistance(float3(pos.x, pos.y, pos.z - h));
+		statsAdd(STAT_NORMAL_EVALUATIONS, 6);
+
+		normal_length = glm::length(normal);
+		h += EPS;
+	}
+	assert(normal_length>0.0f);
+
+	return normal / normal_length;
+}
+
+/// <summary>
+/// Approximates the normal vector for the mandelbox fractal. Uses the analytic gradient of the distance estimator unless finite differences were chosen, or the gradient degenerates.
+/// </summary>
+/// <param name="pos">The position on the fractal for which the normal should be approximated.</param>
+/// <returns>A normalized vector that represents the surface orientation.</returns>
+float3 approxNormal(const float3& pos)
+{
+	if (normal_mode == NORMAL_ANALYTIC)
+	{
+		float3 gradient;
+		mandelBoxGetDistanceGradient(pos, gradient);
+		statsAdd(STAT_NORMAL_EVALUATIONS, 1);
+
+		float gradient_length = glm::length(gradient);
+		if (gradient_length > EPS && gradient_length < std::numeric_limits<float>::infinity())
+			return gradient / gradient_length;
+	}
+
+	return approxNormalFiniteDifference(pos);
+}
+
+
+/// <summary>
+/// Approxes the ambient occlusion for the mandelbox fractal. Works with ao_radius to determin the area on which to check for occluders.
+/// </summary>
+/// <param name="pos">The position on the fractal for which the AO should be approximated.</param>
+/// <param name="normal">The surface normal for pos.</param>
+/// <returns>A value from 0 up to 1 representaing the AO</returns>
+float approxAmbientOcclusion(const float3& pos, const float3& normal, const float& ao_distance)
+{
+	const float ao_offset = ao_distance / ao_steps;
+	float walked_dist = ao_offset; //we need to offset from the start since we are approximating the fractal via a distance threshold
+	for (float i = 0.0f; i < ao_steps; i += 1.0f) //simple ray marching
+	{
+		float3 test_pos = pos + normal * walked_dist; //march along the normal and test for the closest point of the fractal
+		walked_dist += mandelBoxGetDistance(test_pos); 
+		statsAdd(STAT_AO_EVALUATIONS, 1);
+	}
+	return glm::min(1.0f,walked_dist / (ao_offset * (ao_steps + 1.0f))); //divide by the amount we could have idially traveled
+}
+
+/// <summary>
+/// Intersects a ray with the bounding box of the fractal.
+/// </summary>
+/// <param name="ray_pos">The ray origin.</param>
+/// <param name="ray_dir">The ray direction.</param>
+/// <param name="near_distance">[OUT] Distance along the ray where it enters the box. 0 if the origin is inside.</param>
+/// <param name="far_distance">[OUT] Distance along the ray where it leaves the box.</param>
+/// <returns>True if the ray hits the box in front of its origin, false otherwise.</returns>
+bool clipToBounds(const float3& ray_pos, const float3& ray_dir, float& near_distance, float& far_distance)
+{
+	near_distance = 0.0f;
+	far_distance = std::numeric_limits<float>::infinity();
+	if (bounds_mode == BOUNDS_OFF || bounds_half_size == std::numeric_limits<float>::infinity())
+		return true;
+
+	for (uint32_t i = 0; i < 3; i++) //slab test
+	{
+		float inv_dir = 1.0f / ray_dir[i]; //infinity for axis parallel rays, which the min/max handle
+		float t0 = (-bounds_half_size - ray_pos[i]) * inv_dir;
+		float t1 = (bounds_half_size - ray_pos[i]) * inv_dir;
+		near_distance = glm::max(near_distance, glm::min(t0, t1));
+		far_distance = glm::min(far_distance, glm::max(t0, t1));
+	}
+	return near_distance <= far_distance;
+}
+
+/// <summary>
+/// Ray traces the mandelbox. Termination via max_iterations.
+/// With a relaxation above 1 this is the over-relaxed sphere tracing of Keinert et al. 2014: every step goes relaxation times the distance estimate. Once the unbounding spheres of two consecutive steps no longer overlap the ray might have jumped over the surface. It then goes back to the border of the last safe sphere and continues with plain sphere tracing. The same happens when a relaxed step carries the ray past end_distance, so a miss is only reported once plain steps reach the end.
+/// </summary>
+/// <param name="ray_pos">Startin position.</param>
+/// <param name="ray_dir">Ray direction.</param>
+/// <param name="pixel_radius">The inital pixels radius. Used to terminate the marching</param>
+/// <param name="distance">[IN/OUT] The distance of ray_pos from the ray origin, the distance of the ray marching until termination afterwards.</param>
+/// <param name="end_distance">The distance from the ray origin at which the marching gives up.</param>
+/// <param name="steps">[OUT] The number of march steps.</param>
+/// <returns>true if the fractal was hit, false otherwise</returns>
+bool rayTrace(float3& ray_pos, const float3& ray_dir, const float& pixel_radius, float& distance, const float& end_distance, uint32_t& steps)
+{
+	float omega = relaxation;
+	float step = 0.0f; //length of the last step
+	float previous_d = 0.0f; //distance estimate where the last step started
+
+	steps = 0;
+	for (uint32_t it = 0; it < max_iterations; it++) //do the ray tracing
+	{
+		float d = mandelBoxGetDistance(ray_pos);
+		steps++;
+		statsAdd(STAT_MARCH_STEPS, 1);
+
+		if (omega > 1.0f && previous_d + d < step) //the spheres do not overlap, we might have stepped over the surface
+		{
+			distance -= step - previous_d;
+			ray_pos -= ray_dir * (step - previous_d);
+			omega = 1.0f;
+			statsAdd(STAT_OVERSTEPS, 1);
+			continue;
+		}
+
+		bool hit = d < (pixel_radius * (distance + d)); //terminate at sub-pixel width; radius is taken within the pixel and therefore not accurate, but good enough; this also does the AA but also introduces banding
+		step = hit ? d : d * omega; //the last step is never relaxed, so we do not end up inside the fractal
+		previous_d = d;
+
+		distance += step;
+		ray_pos += ray_dir * step;
+
+		if (hit)
+		{
+			return true;
+		}
+
+		if (distance > end_distance) //terminate at max distance or when leaving the bounds
+		{
+			if (omega > 1.0f && distance - step + previous_d <= end_distance) //the relaxed step may have jumped over a surface between the last safe sphere and the end. Finish with plain sphere tracing from its border
+			{
+				distance -= step - previous_d;
+				ray_pos -= ray_dir * (step - previous_d);
+				omega = 1.0f;
+				continue;
+			}
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Ray traces the mandelbox for a whole packet of rays. Every lane keeps its own distance and termination state. The distance estimation is done for all active lanes in one SIMD batch, retired lanes are masked off. Termination and over-relaxation like rayTrace.
+/// </summary>
+/// <param name="packet">[IN/OUT] The packet. Lanes, positions, directions, start and end distances must be set. Positions, distances, hits and steps are written.</param>
+/// <param name="pixel_radius">The inital pixels radius. Used to terminate the marching</param>
+void rayTracePacket(RayPacket& packet, const float& pixel_radius)
+{
+	uint32_t active[max_packet_lanes]; //lanes that are still marching
+	uint32_t active_count = 0;
+	float omega[max_packet_lanes], step[max_packet_lanes], previous_d[max_packet_lanes];
+	for (uint32_t lane = 0; lane < packet.lanes; lane++)
+	{
+		packet.hit[lane] = false;
+		packet.steps[lane] = 0;
+		omega[lane] = relaxation;
+		step[lane] = 0.0f;
+		previous_d[lane] = 0.0f;
+		if (packet.distance[lane] <= packet.end_distance[lane]) //lanes that missed the bounds start retired
+			active[active_count++] = lane;
+	}
+
+	float x[max_packet_lanes], y[max_packet_lanes], z[max_packet_lanes], d[max_packet_lanes];
+
+	for (uint32_t it = 0; it < max_iterations && active_count > 0; it++) //do the ray tracing until all lanes terminated
+	{
+		for (uint32_t i = 0; i < active_count; i++)
+		{
+			const float3& pos = packet.pos[active[i]];
+			x[i] = pos.x;
+			y[i] = pos.y;
+			z[i] = pos.z;
+		}
+
+		mandelBoxGetDistanceBatch(x, y, z, d, active_count);
+		statsAdd(STAT_MARCH_STEPS, active_count);
+
+		uint32_t still_active = 0;
+		for (uint32_t i = 0; i < active_count; i++)
+		{
+			const uint32_t lane = active[i];
+			float& distance = packet.distance[lane];
+			packet.steps[lane]++;
+
+			if (omega[lane] > 1.0f && previous_d[lane] + d[i] < step[lane]) //overstepped. See rayTrace
+			{
+				distance -= step[lane] - previous_d[lane];
+				packet.pos[lane] -= packet.dir[lane] * (step[lane] - previous_d[lane]);
+				omega[lane] = 1.0f;
+				statsAdd(STAT_OVERSTEPS, 1);
+				active[still_active++] = lane;
+				continue;
+			}
+
+			bool hit = d[i] < (pixel_radius * (distance + d[i])); //terminate at sub-pixel width. See rayTrace
+			step[lane] = hit ? d[i] : d[i] * omega[lane];
+			previous_d[lane] = d[i];
+
+			distance += step[lane];
+			packet.pos[lane] += packet.dir[lane] * step[lane];
+
+			if (hit)
+			{
+				packet.hit[lane] = true;
+			}
+			else if (distance <= packet.end_distance[lane]) //otherwise terminate at max distance or when leaving the bounds
+			{
+				active[still_active++] = lane;
+			}
+			else if (omega[lane] > 1.0f && distance - step[lane] + previous_d[lane] <= packet.end_distance[lane]) //relaxed past the end. See rayTrace
+			{
+				distance -= step[lane] - previous_d[lane];
+				packet.pos[lane] -= packet.dir[lane] * (step[lane] - previous_d[lane]);
+				omega[lane] = 1.0f;
+				active[still_active++] = lane;
+			}
+		}
+		active_count = still_active;
+	}
+}
+
+/// <summary>
+/// Calculates the direction of the primary ray through a pixel.
+/// </summary>
+/// <param name="x">The x of the pixel. Fractional values give rays between pixel centers.</param>
+/// <param name="y">The y of the pixel. Fractional values give rays between pixel centers.</param>
+/// <returns>The normalized ray direction.</returns>
+float3 primaryRayDir(const float& x, const float& y)
+{
+	const float u = x / float(width - 1);
+	const float v = y / float(height - 1);
+	const float s = u * 2.0f - 1.0f;
+	const float t = v * 2.0f - 1.0f;
+
+	float3 ray_dir = camera_view + camera_side * tan_hori * s + camera_up * tan_vert * t;
+	return glm::normalize(ray_dir);
+}
+
+/// <summary>
+/// Returns the radius of a pixel at unit distance. Used to terminate the ray marching.
+/// </summary>
+/// <returns>The pixel radius.</returns>
+float primaryPixelRadius()
+{
+	return tan_hori / (float(width) * 0.5f) * 0.5f; //0.5 half side; 0.5 radius
+}
+
+/// <summary>
+/// Finds the part of a primary ray that has to be marched. Clips it against the bounds of the fractal and max_distance.
+/// </summary>
+/// <param name="x">The x of the pixel the ray belongs to.</param>
+/// <param name="y">The y of the pixel the ray belongs to.</param>
+/// <param name="ray_dir">The direction of the ray.</param>
+/// <param name="start_distance">[OUT] Distance from the camera at which the marching starts.</param>
+/// <param name="end_distance">[OUT] Distance from the camera at which the marching gives up.</param>
+/// <returns>False if the ray can not hit the fractal at all.</returns>
+bool startPrimaryRay(const uint32_t& x, const uint32_t& y, const float3& ray_dir, float& start_distance, float& end_distance)
+{
+	statsAdd(STAT_PRIMARY_RAYS, 1);
+
+	float near_distance = 0.0f;
+	float far_distance = 0.0f;
+	if (!clipToBounds(camera_pos, ray_dir, near_distance, far_distance) || near_distance > max_distance)
+	{
+		statsAdd(STAT_RAYS_CULLED, 1);
+		return false;
+	}
+
+	start_distance = bounds_mode == BOUNDS_ENTER ? near_distance : 0.0f; //marching from the camera takes the same steps as without bounds, so the hits do not move
+	end_distance = glm::min(far_distance, max_distance);
+	if (start_distance > 0.0f || end_distance < max_distance)
+		statsAdd(STAT_RAYS_CLIPPED, 1);
+
+	if (beam_distance != nullptr) //continue where the beam of the pixel stopped
+	{
+		start_distance = glm::max(start_distance, beam_distance[imageIndex(x, y)]);
+		return start_distance <= end_distance;
+	}
+	return true;
+}
+
+/// <summary>
+/// Marches a cone around all primary rays of a rectangle of pixels. All rays are at the same distance from the camera, so none of them is further than distance * chord away from the cones axis, where chord is the largest distance between the direction of the axis and the direction of a ray. Everything within the distance estimate d around the axis is empty, so every ray can safely advance by d - distance * chord. Once that step gets smaller than the cone radius the beam is split into four sub-beams that continue from there. Single pixels store the distance in beam_distance, their rays start marching at it.
+/// </summary>
+/// <param name="x0">The x of the lower left pixel of the rectangle.</param>
+/// <param name="y0">The y of the lower left pixel of the rectangle.</param>
+/// <param name="x1">The x past the upper right pixel of the rectangle.</param>
+/// <param name="y1">The y past the upper right pixel of the rectangle.</param>
+/// <param name="distance">The distance up to which all rays of the rectangle are known to be empty.</param>
+/// <param name="end_distance">The distance at which all rays of the rectangle give up.</param>
+void marchBeam(const uint32_t& x0, const uint32_t& y0, const uint32_t& x1, const uint32_t& y1, float distance, const float& end_distance)
+{
+	if (x1 - x0 > 1 || y1 - y0 > 1)
+	{
+		const float3 axis = primaryRayDir(0.5f * float(x0 + x1 - 1), 0.5f * float(y0 + y1 - 1));
+		float chord = 0.0f; //the rays furthest away from the axis go through the corners
+		chord = glm::max(chord, glm::length(primaryRayDir(float(x0), float(y0)) - axis));
+		chord = glm::max(chord, glm::length(primaryRayDir(float(x1 - 1), float(y0)) - axis));
+		chord = glm::max(chord, glm::length(primaryRayDir(float(x0), float(y1 - 1)) - axis));
+		chord = glm::max(chord, glm::length(primaryRayDir(float(x1 - 1), float(y1 - 1)) - axis));
+
+		for (uint32_t it = 0; it < max_iterations; it++)
+		{
+			float d = mandelBoxGetDistance(camera_pos + axis * distance);
+			statsAdd(STAT_BEAM_STEPS, 1);
+
+			float radius = distance * chord;
+			if (d < 1.5f * radius) //steps got shorter than half the cone radius, narrower beams get further
+				break;
+
+			distance += d - radius;
+			if (distance > end_distance) //no ray of the beam hits anything
+			{
+				distance = std::numeric_limits<float>::infinity();
+				break;
+			}
+		}
+
+		if (distance != std::numeric_limits<float>::infinity())
+		{
+			const uint32_t xm = (x0 + x1 + 1) / 2;
+			const uint32_t ym = (y0 + y1 + 1) / 2;
+			marchBeam(x0, y0, xm, ym, distance, end_distance);
+			if (xm < x1)
+				marchBeam(xm, y0, x1, ym, distance, end_distance);
+			if (ym < y1)
+				marchBeam(x0, ym, xm, y1, distance, end_distance);
+			if (xm < x1 && ym < y1)
+				marchBeam(xm, ym, x1, y1, distance, end_distance);
+			return;
+		}
+	}
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			beam_distance[imageIndex(x, y)] = distance;
+		}
+	}
+}
+
+/// <summary>
+/// Runs the beam marching for a tile of the image. The top level beam starts where the first of its rays enters the bounds of the fractal.
+/// </summary>
+/// <param name="x0">The x of the lower left pixel of the tile.</param>
+/// <param name="y0">The y of the lower left pixel of the tile.</param>
+/// <param name="x1">The x past the upper right pixel of the tile.</param>
+/// <param name="y1">The y past the upper right pixel of the tile.</param>
+void marchTileBeam(const uint32_t& x0, const uint32_t& y0, const uint32_t& x1, const uint32_t& y1)
+{
+	float start_distance = std::numeric_limits<float>::infinity();
+	float end_distance = 0.0f;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			float near_distance = 0.0f;
+			float far_distance = 0.0f;
+			if (clipToBounds(camera_pos, primaryRayDir(float(x), float(y)), near_distance, far_distance))
+			{
+				start_distance = glm::min(start_distance, near_distance);
+				end_distance = glm::max(end_distance, glm::min(far_distance, max_distance));
+			}
+		}
+	}
+
+	marchBeam(x0, y0, x1, y1, glm::min(start_distance, end_distance), end_distance);
+}
+
+/// <summary>
+/// Shades a point where a primary ray hit the fractal.
+/// </summary>
+/// <param name="fractal_pos">The hit position.</param>
+/// <param name="ray_dir">The direction of the ray.</param>
+/// <param name="surface_color">[OUT] The orbit trap color of the surface.</param>
+/// <param name="surface_normal">[OUT] The normal of the surface.</param>
+/// <param name="surface_ao">[OUT] The ambient occlusion, 1 if it is disabled.</param>
+/// <returns>The SRGB color of the pixel.</returns>
+float3 shadeHit(const float3& fractal_pos, const float3& ray_dir, float3& surface_color, float3& surface_normal, float& surface_ao)
+{
+	//gather attributes of the hit
+	surface_color = mandelboxGetColor(fractal_pos);
+	statsAdd(STAT_COLOR_EVALUATIONS, 1);
+	surface_normal = approxNormal(fractal_pos);
+	surface_ao = ao_steps > 0.0f ? approxAmbientOcclusion(fractal_pos, surface_normal, ao_radius) : 1.0f; //for simplicity we use a global radius. This can be tuned to adjust for the 'zoom' in the given camera setup
+
+	//the material is derived from the orbit trap color
+	float3 ambient_color = surface_color * surface_ao * shading_factors.x;
+	float3 diffuse_color = surface_color * shading_factors.y;
+	float3 specular_color = float3(1,1,1) * shading_factors.z;
+
+	//do the lighting
+	float3 blinn_phong = brdfBlinnPhong(surface_normal, ambient_color, diffuse_color, specular_color, -ray_dir, light_dir, light_color);
+
+	//SRGB correction
+	return glm::pow(blinn_phong, float3(output_inverse_gamma, output_inverse_gamma, output_inverse_gamma));
+}
+
+/// <summary>
+/// Where measuring the cost of a pixel started.
+/// </summary>
+struct PixelCost
+{
+	std::chrono::steady_clock::time_point start;
+	uint64_t de_evaluations; //counted by the thread so far
+};
+
+/// <summary>
+/// Starts measuring the cost of a pixel, if the cost layer is enabled.
+/// </summary>
+/// <param name="cost">[OUT] The start of the measurement.</param>
+void costStart(PixelCost& cost)
+{
+	if (aov_buffers[AOV_COST] == nullptr)
+		return;
+	cost.de_evaluations = statsThreadGet(STAT_DE_EVALUATIONS);
+	cost.start = std::chrono::steady_clock::now();
+}
+
+/// <summary>
+/// Finishes measuring the cost of a pixel. The DE evaluations are those of the thread since costStart, so they include the normal and the ambient occlusion.
+/// </summary>
+/// <param name="cost">The start of the measurement.</param>
+/// <param name="steps">The march steps of the ray.</param>
+/// <returns>The march steps, the DE evaluations and the nanoseconds. Zero if the cost layer is disabled.</returns>
+float3 costEnd(const PixelCost& cost, const uint32_t& steps)
+{
+	if (aov_buffers[AOV_COST] == nullptr)
+		return float3(0, 0, 0);
+	const float nanoseconds = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - cost.start).count();
+	return float3(float(steps), float(statsThreadGet(STAT_DE_EVALUATIONS) - cost.de_evaluations), nanoseconds);
+}
+
+/// <summary>
+/// Writes the AOVs of a pixel into the enabled layers.
+/// </summary>
+/// <param name="x">The x of the pixel.</param>
+/// <param name="y">The y of the pixel.</param>
+/// <param name="hit">True if the ray hit the fractal. The surface attributes are only used then.</param>
+/// <param name="distance">The distance of the hit from the camera.</param>
+/// <param name="steps">The march steps of the ray.</param>
+/// <param name="surface_color">The orbit trap color of the surface.</param>
+/// <param name="surface_normal">The normal of the surface.</param>
+/// <param name="surface_ao">The ambient occlusion.</param>
+/// <param name="cost">The cost of the pixel, see costEnd.</param>
+void storeAov(const uint32_t& x, const uint32_t& y, const bool& hit, const float& distance, const uint32_t& steps, const float3& surface_color, const float3& surface_normal, const float& surface_ao, const float3& cost)
+{
+	const size_t index = imageIndex(x, y);
+	if (aov_buffers[AOV_DEPTH] != nullptr)
+		aov_buffers[AOV_DEPTH][index] = hit ? distance : max_distance;
+	if (aov_buffers[AOV_NORMAL] != nullptr)
+		*reinterpret_cast<float3*>(aov_buffers[AOV_NORMAL] + index * 3) = hit ? surface_normal : float3(0, 0, 0);
+	if (aov_buffers[AOV_AO] != nullptr)
+		aov_buffers[AOV_AO][index] = hit ? surface_ao : 0.0f;
+	if (aov_buffers[AOV_STEPS] != nullptr)
+		aov_buffers[AOV_STEPS][index] = float(steps);
+	if (aov_buffers[AOV_TRAP] != nullptr)
+		*reinterpret_cast<float3*>(aov_buffers[AOV_TRAP] + index * 3) = hit ? surface_color : float3(0, 0, 0);
+	if (aov_buffers[AOV_COST] != nullptr)
+		*reinterpret_cast<float3*>(aov_buffers[AOV_COST] + index * 3) = cost;
+}
+
+/// <summary>
+/// On render thread represents on pixel. Writes a color into the pixels location within the tile buffer, if the ray tracing hits the fractal.
+/// </summary>
+/// <param name="x">The x of the pixel to render.</param>
+/// <param name="y">The y of the pixel to render.</param>
+/// <param name="pixel">[OUT] The pixel within the tile buffer. Left untouched if the ray misses.</param>
+void renderThread(const uint32_t& x, const uint32_t& y, float3& pixel)
+{
+	PixelCost cost = {};
+	costStart(cost);
+
+	float3 ray_dir = primaryRayDir(x, y);
+	float pixel_radius = primaryPixelRadius();
+
+	//skip the empty space in front of and behind the bounds of the fractal
+	float distance = 0.0f;
+	float end_distance = 0.0f;
+	float3 surface_color, surface_normal;
+	float surface_ao = 0.0f;
+	if (!startPrimaryRay(x, y, ray_dir, distance, end_distance))
+	{
+		storeAov(x, y, false, distance, 0, surface_color, surface_normal, surface_ao, costEnd(cost, 0));
+		return;
+	}
+
+	//init and do the ray tracing
+	float3 fractal_pos = camera_pos + ray_dir * distance;
+
+	uint32_t steps = 0;
+	bool res = rayTrace(fractal_pos, ray_dir, pixel_radius, distance, end_distance, steps);
+
+	if (res) //we actually hit the fractal
+	{
+		statsAdd(STAT_PRIMARY_HITS, 1);
+		pixel = shadeHit(fractal_pos, ray_dir, surface_color, surface_normal, surface_ao); //write to our tile buffer
+	}
+	storeAov(x, y, res, distance, steps, surface_color, surface_normal, surface_ao, costEnd(cost, steps));
+}
+
+/// <summary>
+/// Renders a packet of packet_width x packet_height neighbouring pixels of a lattice. The primary rays are marched together, so the distance estimation can be done for all of them in one SIMD batch. Hits are shaded per pixel. The time of the marching is split evenly over the pixels for the cost layer.
+/// </summary>
+/// <param name="x0">The x of the lower left pixel of the packet.</param>
+/// <param name="y0">The y of the lower left pixel of the packet.</param>
+/// <param name="lattice">The pixels that are rendered. Neighbours within the packet are one lattice step apart.</param>
+/// <param name="tile">The tile the packet belongs to. Pixels outside of it are left out of the packet.</param>
+/// <param name="buffer">[OUT] The buffer of the tile. Hits are written into it.</param>
+void renderPacket(const uint32_t& x0, const uint32_t& y0, const PixelLattice& lattice, const Tile& tile, TileBuffer& buffer)
+{
+	RayPacket packet;
+	packet.lanes = 0;
+	PixelCost march_cost = {};
+	costStart(march_cost);
+
+	for (uint32_t py = 0; py < packet_height; py++)
+	{
+		for (uint32_t px = 0; px < packet_width; px++)
+		{
+			const uint32_t x = x0 + px * lattice.x_step;
+			const uint32_t y = y0 + py * lattice.y_step;
+			if (x >= tile.x1 || y >= tile.y1) //packets at the tile border are only partially filled
+				continue;
+
+			const uint32_t lane = packet.lanes++;
+			packet.x[lane] = x;
+			packet.y[lane] = y;
+			packet.dir[lane] = primaryRayDir(x, y);
+			if (!startPrimaryRay(x, y, packet.dir[lane], packet.distance[lane], packet.end_distance[lane]))
+			{
+				packet.distance[lane] = 1.0f; //retire the lane right away
+				packet.end_distance[lane] = 0.0f;
+			}
+			packet.pos[lane] = camera_pos + packet.dir[lane] * packet.distance[lane];
+		}
+	}
+
+	rayTracePacket(packet, primaryPixelRadius());
+	const float march_nanoseconds = costEnd(march_cost, 0).z / float(glm::max(packet.lanes, 1u));
+
+	for (uint32_t lane = 0; lane < packet.lanes; lane++)
+	{
+		float3 surface_color, surface_normal;
+		float surface_ao = 0.0f;
+		PixelCost cost = {};
+		costStart(cost);
+		if (packet.hit[lane])
+		{
+			statsAdd(STAT_PRIMARY_HITS, 1);
+			const uint32_t x = packet.x[lane] - tile.x0;
+			const uint32_t y = packet.y[lane] - tile.y0;
+			buffer.pixels[y * buffer.stride + x] = shadeHit(packet.pos[lane], packet.dir[lane], surface_color, surface_normal, surface_ao);
+		}
+		const float3 lane_cost = costEnd(cost, packet.steps[lane]) + float3(0, packet.steps[lane], march_nanoseconds); //every step of the lane was one DE evaluation within the batch
+		storeAov(packet.x[lane], packet.y[lane], packet.hit[lane], packet.distance[lane], packet.steps[lane], surface_color, surface_normal, surface_ao, lane_cost);
+	}
+}
+
+/// <summary>
+/// Renders the pixels of a lattice within a tile into a thread local buffer and copies the tile into the image afterwards. Runs the beam marching first if it is enabled, then marches packets or single rays.
+/// </summary>
+/// <param name="tile">The tile to render.</param>
+/// <param name="buffer">[IN/OUT] The buffer of the rendering thread.</param>
+/// <param name="lattice">The pixels to render.</param>
+/// <param name="first_visit">True if no pixel of the tile was rendered before. Otherwise the pixels rendered so far are kept and the beams are reused.</param>
+void renderTile(const Tile& tile, TileBuffer& buffer, const PixelLattice& lattice, const bool& first_visit)
+{
+	if (first_visit)
+	{
+		tileBufferClear(buffer, tile);
+	}
+	else
+	{
+		tileBufferCopyIn(buffer, tile, image, frame_format, width, image_y0);
+	}
+
+	if (beam_distance != nullptr && first_visit)
+	{
+		for (uint32_t y = tile.y0; y < tile.y1; y += beam_size)
+		{
+			for (uint32_t x = tile.x0; x < tile.x1; x += beam_size)
+			{
+				marchTileBeam(x, y, glm::min(x + beam_size, tile.x1), glm::min(y + beam_size, tile.y1));
+			}
+		}
+	}
+
+	if (packet_width * packet_height > 1)
+	{
+		for (uint32_t y = tile.y0 + lattice.y_offset; y < tile.y1; y += packet_height * lattice.y_step)
+		{
+			for (uint32_t x = tile.x0 + lattice.x_offset; x < tile.x1; x += packet_width * lattice.x_step)
+			{
+				renderPacket(x, y, lattice, tile, buffer);
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t y = tile.y0 + lattice.y_offset; y < tile.y1; y += lattice.y_step)
+		{
+			for (uint32_t x = tile.x0 + lattice.x_offset; x < tile.x1; x += lattice.x_step)
+			{
+				renderThread(x, y, buffer.pixels[(y - tile.y0) * buffer.stride + (x - tile.x0)]);
+			}
+		}
+	}
+
+	tileBufferCopyOut(buffer, tile, image, frame_format, width, image_y0);
+}
+
+/// <summary>
+/// The tiles of a frame and the buffers of the threads that render them.
+/// </summary>
+struct TileJob
+{
+	std::vector<Tile> tiles;
+	uint32_t first_tile; //task i renders tile first_tile + i
+	PixelLattice lattice; //the pixels rendered within the tiles
+	bool first_visit; //true if the tiles were not rendered before
+	std::vector<TileBuffer> buffers; //one per thread, allocated by the thread itself
+	std::atomic<bool> buffers_missing;
+};
+
+/// <summary>
+/// Returns the tile buffer of a thread. Allocates it on first use, so its memory is first touched by the thread that works with it.
+/// </summary>
+/// <param name="job">[IN/OUT] The job.</param>
+/// <param name="thread_index">The number of the thread.</param>
+/// <returns>The buffer, or nullptr if it could not be allocated.</returns>
+TileBuffer* threadTileBuffer(TileJob& job, const uint32_t& thread_index)
+{
+	TileBuffer& buffer = job.buffers[thread_index];
+	if (buffer.pixels == nullptr && !tileBufferCreate(buffer, tile_size))
+	{
+		job.buffers_missing = true;
+		return nullptr;
+	}
+	return &buffer;
+}
+
+/// <summary>
+/// Pool task that touches the rows of a tile within the image and the AOV layers for the first time. Run without stealing and with the same tile count as the rendering, this places the pages of the image on the memory of the NUMA node of the thread that mostly writes them. A mapped output file is zero already and left alone, clearing it would only double the writes to the disk. Its pages are placed by the first tile written to them instead.
+/// </summary>
+/// <param name="task">The number of the tile.</param>
+/// <param name="thread_index">The number of the thread.</param>
+/// <param name="data">The TileJob.</param>
+void touchTileTask(const uint32_t& task, const uint32_t& thread_index, void* data)
+{
+	TileJob& job = *static_cast<TileJob*>(data);
+	const Tile& tile = job.tiles[task];
+	const std::chrono::steady_clock::time_point start = traceEnabled() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+	for (uint32_t y = tile.y0; !image_mapped && y < tile.y1; y++)
+	{
+		std::memset(image + imageIndex(tile.x0, y) * frame_pixel_size, 0, (tile.x1 - tile.x0) * frame_pixel_size);
+	}
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		const uint32_t channels = aov_layers[layer].channels;
+		for (uint32_t y = tile.y0; aov_buffers[layer] != nullptr && y < tile.y1; y++)
+			std::memset(aov_buffers[layer] + imageIndex(tile.x0, y) * channels, 0, (tile.x1 - tile.x0) * channels * sizeof(float));
+	}
+	threadTileBuffer(job, thread_index);
+	if (traceEnabled())
+		traceRectEvent(thread_index, "touch", "render", start, std::chrono::steady_clock::now(), tile.x0, tile.y0, tile.x1, tile.y1);
+}
+
+/// <summary>
+/// Pool task that renders the lattice pixels of a tile.
+/// </summary>
+/// <param name="task">The number of the tile, counted from the first tile of the job.</param>
+/// <param name="thread_index">The number of the thread.</param>
+/// <param name="data">The TileJob.</param>
+void renderTileTask(const uint32_t& task, const uint32_t& thread_index, void* data)
+{
+	TileJob& job = *static_cast<TileJob*>(data);
+	const std::chrono::steady_clock::time_point start = traceEnabled() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+	TileBuffer* buffer = threadTileBuffer(job, thread_index);
+	const Tile& tile = job.tiles[job.first_tile + task];
+	if (buffer != nullptr)
+	{
+		renderTile(tile, *buffer, job.lattice, job.first_visit);
+	}
+	if (traceEnabled())
+		traceRectEvent(thread_index, "tile", "render", start, std::chrono::steady_clock::now(), tile.x0, tile.y0, tile.x1, tile.y1);
+}
+
+/// <summary>
+/// Pool task that notes the performance counters of its thread at the start of a phase. Run once per thread.
+/// </summary>
+/// <param name="task">Unused.</param>
+/// <param name="thread_index">The number of the thread.</param>
+/// <param name="data">Unused.</param>
+void perfBeginTask(const uint32_t& /*task*/, const uint32_t& thread_index, void* /*data*/)
+{
+	perfPhaseBegin(thread_index);
+}
+
+/// <summary>
+/// Pool task that adds what its thread counted since perfBeginTask to a phase. Run once per thread.
+/// </summary>
+/// <param name="task">Unused.</param>
+/// <param name="thread_index">The number of the thread.</param>
+/// <param name="data">The StatPhase.</param>
+void perfEndTask(const uint32_t& /*task*/, const uint32_t& thread_index, void* data)
+{
+	perfPhaseEnd(thread_index, *static_cast<const StatPhase*>(data));
+}
+
+/// <summary>
+/// Runs a task once on every thread of the pool to read the performance counters, if they are enabled. Without stealing every thread gets exactly one of the tasks.
+/// </summary>
+/// <param name="task">perfBeginTask or perfEndTask.</param>
+/// <param name="phase">The phase handed to the task.</param>
+void perfSampleThreads(PoolTask task, StatPhase phase)
+{
+	if (perfEnabled())
+		poolRun(poolGetThreadCount(), task, &phase, false);
+}
+
+//-----------------------------------------|
+// writing the output and rendering the    |
+// frame, progressively if configured      |
+//-----------------------------------------|
+
+/// <summary>
+/// Checks if str starts with the char sequence pre
+/// </summary>
+/// <param name="pre">The char sequence to check for.</param>
+/// <param name="str">The string which may or may not contain pre.</param>
+/// <returns>True if str starts with the sequence pre. False otherwise</returns>
+bool startsWith(const char *pre, const char *str) {
+	size_t len_pre = strlen(pre);
+	size_t len_str = strlen(str);
+	return len_str < len_pre ? false : strncmp(pre, str, len_pre) == 0;
+}
+
+/// <summary>
+/// Checks if str ends with the char sequence post
+/// </summary>
+/// <param name="post">The char sequence to check for.</param>
+/// <param name="str">The string which may or may not contain post.</param>
+/// <returns>True if str ends with the sequence pre. False otherwise</returns>
+bool endsWith(const char *post, const char *str) {
+	size_t len_post = strlen(post);
+	size_t len_str = strlen(str);
+	return len_str < len_post ? false : strncmp(post, str + (len_str - len_post), len_post) == 0;
+}
+
+/// <summary>
+/// Writes an image to a file. Files ending with .bmp are written as bitmap, which needs a float copy of compact frame formats. Everything else is written in the file format of the frame format, see frameFileHeader.
+/// </summary>
+/// <param name="filename">The file to write.</param>
+/// <param name="pixels">The pixels of the image in frame_format.</param>
+/// <returns>True if writing the file succeeded, false otherwise.</returns>
+bool saveImage(const char* filename, const uint8_t* pixels)
+{
+	if (endsWith(".bmp", filename))
+	{
+		float3* decoded = nullptr;
+		if (frame_format != FRAME_FORMAT_RGB32F)
+		{
+			decoded = (float3*)std::malloc(sizeof(float3)*pixel_count);
+			if (decoded == nullptr)
+				return false;
+			frameDecodeRow(frame_format, pixels, pixel_count, decoded);
+		}
+		const float* floats = decoded != nullptr ? (const float*)decoded : (const float*)pixels;
+		const bool chk = bmp_cimg ? saveFloatImageBMPCImg(filename, floats, width, height) : saveFloatImageBMP(filename, floats, width, height, bmp_dither);
+		std::free(decoded);
+		return chk;
+	}
+	else if (frame_format == FRAME_FORMAT_RGB32F)
+	{
+		return saveFloatImagePFM(filename, (const float*)pixels, width, height);
+	}
+	else
+	{
+		FrameStream stream;
+		if (!frameStreamOpen(stream, filename, width, height, frame_format))
+			return false;
+		const bool chk = frameStreamWriteRows(stream, pixels, height);
+		return frameStreamClose(stream) && chk;
+	}
+}
+
+/// <summary>
+/// Returns the file an AOV layer is written to: the output file without its ending, followed by the name of the layer and .pfm.
+/// </summary>
+/// <param name="output">The output file.</param>
+/// <param name="layer">The AOV layer.</param>
+/// <returns>The file of the layer.</returns>
+std::string aovFilename(const char* output, const uint32_t& layer)
+{
+	std::string filename = output;
+	const size_t dot = filename.find_last_of('.');
+	const size_t separator = filename.find_last_of("/\\");
+	if (dot != std::string::npos && (separator == std::string::npos || dot > separator))
+		filename.resize(dot);
+	return filename + "." + aov_layers[layer].name + ".pfm";
+}
+
+/// <summary>
+/// Creates the files of the enabled AOV layers. The rows are appended in bands like the output, so they work with and without streaming.
+/// </summary>
+/// <param name="output">The output file.</param>
+/// <param name="streams">[OUT] One stream per layer. The file of disabled layers is nullptr.</param>
+/// <returns>False if a file could not be created.</returns>
+bool aovStreamsOpen(const char* output, FrameStream* streams)
+{
+	bool chk = true;
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		streams[layer].file = nullptr;
+		if (aov_buffers[layer] != nullptr)
+			chk = pfmStreamOpen(streams[layer], aovFilename(output, layer).c_str(), width, height, aov_layers[layer].channels) && chk;
+	}
+	return chk;
+}
+
+/// <summary>
+/// Appends the rows held by the AOV layers to their files.
+/// </summary>
+/// <param name="streams">[IN/OUT] The streams of the layers.</param>
+/// <param name="row_count">The number of rows, starting at image_y0.</param>
+/// <returns>False if writing went wrong.</returns>
+bool aovStreamsWriteRows(FrameStream* streams, const uint32_t& row_count)
+{
+	bool chk = true;
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		if (streams[layer].file != nullptr)
+			chk = frameStreamWriteRows(streams[layer], aov_buffers[layer], row_count) && chk;
+	}
+	return chk;
+}
+
+/// <summary>
+/// Finishes the files of the AOV layers.
+/// </summary>
+/// <param name="streams">[IN/OUT] The streams of the layers.</param>
+/// <returns>False if a file is incomplete or could not be closed.</returns>
+bool aovStreamsClose(FrameStream* streams)
+{
+	bool chk = true;
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		if (streams[layer].file != nullptr)
+			chk = frameStreamClose(streams[layer]) && chk;
+	}
+	return chk;
+}
+
+/// <summary>
+/// Frees the buffers of the AOV layers.
+/// </summary>
+void aovBuffersFree()
+{
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		std::free(aov_buffers[layer]);
+		aov_buffers[layer] = nullptr;
+	}
+}
+
+/// <summary>
+/// Maps a value from 0 to 1 to a color running from black over blue, cyan, green, yellow and red to white.
+/// </summary>
+/// <param name="t">The value.</param>
+/// <returns>The color.</returns>
+float3 heatColor(const float& t)
+{
+	const uint32_t stop_count = 7;
+	const float3 stops[stop_count] = { float3(0, 0, 0), float3(0, 0, 1), float3(0, 1, 1), float3(0, 1, 0), float3(1, 1, 0), float3(1, 0, 0), float3(1, 1, 1) };
+	const float position = glm::clamp(t, 0.0f, 1.0f) * float(stop_count - 1);
+	const uint32_t stop = glm::min(uint32_t(position), stop_count - 2);
+	return glm::mix(stops[stop], stops[stop + 1], position - float(stop));
+}
+
+/// <summary>
+/// Writes a false color heatmap of the cost layer next to it, as .cost.bmp. The layer is read back from its file, so it works with streaming in bands as well. The costs span orders of magnitude and are shown on a logarithmic scale, black is the cheapest and white the most expensive pixel.
+/// </summary>
+/// <param name="output">The output file.</param>
+/// <returns>False if the cost layer could not be read or the heatmap could not be written.</returns>
+bool saveCostHeatmap(const char* output)
+{
+	const std::string layer_file = aovFilename(output, AOV_COST);
+	uint32_t layer_width = 0;
+	uint32_t layer_height = 0;
+	uint32_t channels = 0;
+	float* costs = loadFloatImagePFM(layer_file.c_str(), layer_width, layer_height, channels);
+	if (costs == nullptr || channels != aov_layers[AOV_COST].channels)
+	{
+		std::free(costs);
+		return false;
+	}
+
+	const size_t count = size_t(layer_width) * layer_height;
+	float min_cost = std::numeric_limits<float>::infinity();
+	float max_cost = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		min_cost = glm::min(min_cost, glm::max(costs[i * channels + heatmap_channel], 0.0f));
+		max_cost = glm::max(max_cost, costs[i * channels + heatmap_channel]);
+	}
+	const float log_min = count > 0 ? std::log1p(min_cost) : 0.0f;
+	const float scale = max_cost > min_cost ? 1.0f / (std::log1p(max_cost) - log_min) : 0.0f;
+
+	float3* colors = reinterpret_cast<float3*>(costs); //converted in place, every pixel has three channels
+	for (size_t i = 0; i < count; i++)
+		colors[i] = heatColor((std::log1p(glm::max(costs[i * channels + heatmap_channel], 0.0f)) - log_min) * scale);
+
+	const std::string heatmap_file = layer_file.substr(0, layer_file.size() - 4) + ".bmp";
+	const bool chk = saveFloatImageBMP(heatmap_file.c_str(), costs, layer_width, layer_height, false);
+	std::free(costs);
+	return chk;
+}
+
+/// <summary>
+/// Upscales what the progressive rendering has so far. Every pixel that was not traced yet copies the traced pixel at the lower left of its block, so every tile looks like a lower resolution version of itself. Tiles that were not rendered at all are black.
+/// </summary>
+/// <param name="job">The job of the progressive rendering.</param>
+/// <param name="tile_passes">The number of passes done for each tile.</param>
+/// <param name="target">[OUT] Buffer for the upscaled image, width * height pixels. May be image itself once the rendering stopped, the traced pixels only copy onto themselves.</param>
+void upscaleProgressive(const TileJob& job, const std::vector<uint32_t>& tile_passes, uint8_t* target)
+{
+	for (size_t t = 0; t < job.tiles.size(); t++)
+	{
+		const Tile& tile = job.tiles[t];
+		const ProgressivePass* pass = tile_passes[t] > 0 ? &progressive_passes[tile_passes[t] - 1] : nullptr;
+		for (uint32_t y = tile.y0; y < tile.y1; y++)
+		{
+			for (uint32_t x = tile.x0; x < tile.x1; x++)
+			{
+				if (pass == nullptr)
+				{
+					std::memset(target + imageIndex(x, y) * frame_pixel_size, 0, frame_pixel_size);
+					continue;
+				}
+				const uint32_t source_x = x - (x - tile.x0) % pass->block_width;
+				const uint32_t source_y = y - (y - tile.y0) % pass->block_height;
+				std::memmove(target + imageIndex(x, y) * frame_pixel_size, image + imageIndex(source_x, source_y) * frame_pixel_size, frame_pixel_size);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Upscales the AOV layers in place like upscaleProgressive does with the image. Only the pixels that were not traced yet are overwritten, so this is done once the rendering stopped for good. Tiles that were not rendered at all stay zero.
+/// </summary>
+/// <param name="job">The job of the progressive rendering.</param>
+/// <param name="tile_passes">The number of passes done for each tile.</param>
+void upscaleAovs(const TileJob& job, const std::vector<uint32_t>& tile_passes)
+{
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		float* values = aov_buffers[layer];
+		const uint32_t channels = aov_layers[layer].channels;
+		for (size_t t = 0; values != nullptr && t < job.tiles.size(); t++)
+		{
+			const Tile& tile = job.tiles[t];
+			if (tile_passes[t] == 0)
+				continue;
+			const ProgressivePass& pass = progressive_passes[tile_passes[t] - 1];
+			for (uint32_t y = tile.y0; y < tile.y1; y++)
+			{
+				for (uint32_t x = tile.x0; x < tile.x1; x++)
+				{
+					const uint32_t source_x = x - (x - tile.x0) % pass.block_width;
+					const uint32_t source_y = y - (y - tile.y0) % pass.block_height;
+					std::memmove(values + imageIndex(x, y) * channels, values + imageIndex(source_x, source_y) * channels, channels * sizeof(float));
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Counts the pixels of a lattice within a tile.
+/// </summary>
+/// <param name="tile">The tile.</param>
+/// <param name="lattice">The lattice.</param>
+/// <returns>The number of pixels.</returns>
+uint32_t latticePixelCount(const Tile& tile, const PixelLattice& lattice)
+{
+	const uint32_t tile_width = tile.x1 - tile.x0;
+	const uint32_t tile_height = tile.y1 - tile.y0;
+	if (tile_width <= lattice.x_offset || tile_height <= lattice.y_offset)
+		return 0;
+	return ((tile_width - lattice.x_offset + lattice.x_step - 1) / lattice.x_step) * ((tile_height - lattice.y_offset + lattice.y_step - 1) / lattice.y_step);
+}
+
+/// <summary>
+/// Returns the seconds since the rendering started.
+/// </summary>
+/// <returns>The elapsed time in seconds.</returns>
+float renderSeconds()
+{
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - render_start).count();
+}
+
+/// <summary>
+/// Renders the image in passes from coarse to fine. Every pass traces the pixels of one lattice in every tile, no pixel is traced twice. The passes are split into batches of tiles, after each batch a snapshot is written to the output file once progressive_interval seconds went by since the last one.
+/// With a budget the time per traced pixel is measured for every batch, and used to predict the batch in the next pass, which covers the same tiles. Batches of the first pass are predicted with the average of the ones before. If the passes left would not fit into the remaining time at the end of a pass, the next quality level is applied. If the next batch would not fit anymore, the refinement stops and the image is upscaled from what was traced so far.
+/// </summary>
+/// <param name="filename">The output file.</param>
+/// <param name="job">[IN/OUT] The job with the tiles and the thread buffers.</param>
+/// <returns>False if a snapshot could not be allocated or written.</returns>
+bool renderProgressive(const char* filename, TileJob& job)
+{
+	const uint32_t tile_count = uint32_t(job.tiles.size());
+	const uint32_t batch_size = glm::max(poolGetThreadCount() * 4, (tile_count + 7) / 8); //roughly eight batches per pass, enough tiles to keep all threads busy
+	const uint32_t batch_count = (tile_count + batch_size - 1) / batch_size;
+	std::vector<uint32_t> tile_passes(tile_count, 0);
+
+	uint8_t* snapshot = nullptr; //only snapshots need a copy, the image keeps being rendered while they are written
+	if (progressive_interval > 0.0f)
+		snapshot = (uint8_t*)std::malloc(size_t(frame_pixel_size)*pixel_count);
+	if (progressive_interval > 0.0f && snapshot == nullptr)
+	{
+		*message_stream << "Could not allocate the necessary memory for the snapshot buffer!" << std::endl;
+		return false;
+	}
+
+	//state of the budget mode
+	const float budget = budget_ms * 0.001f;
+	const float default_ao_steps = ao_steps;
+	const uint32_t default_max_iterations = max_iterations;
+	const float default_relaxation = relaxation;
+	uint32_t quality_level = 0; //0 is the full quality, i the quality_levels[i - 1]
+	uint32_t lowered_in_pass[quality_level_count] = { 0 };
+	std::vector<float> batch_seconds_per_pixel(batch_count, 0.0f); //last measurement of each batch
+	float measured_seconds = 0.0f; //sums over the first pass, to predict the batches not measured yet
+	uint32_t measured_pixels = 0;
+	bool deadline_hit = false;
+
+	std::chrono::steady_clock::time_point last_snapshot = std::chrono::steady_clock::now();
+	for (uint32_t pass = 0; pass < progressive_pass_count && !deadline_hit; pass++)
+	{
+		job.lattice = progressive_passes[pass].lattice;
+		job.first_visit = pass == 0;
+
+		for (uint32_t batch = 0; batch < batch_count; batch++)
+		{
+			const uint32_t first_tile = batch * batch_size;
+			const uint32_t batch_end = glm::min(first_tile + batch_size, tile_count);
+			uint32_t batch_pixels = 0;
+			for (uint32_t t = first_tile; t < batch_end; t++)
+				batch_pixels += latticePixelCount(job.tiles[t], job.lattice);
+
+			const float batch_start = renderSeconds();
+			if (budget > 0.0f)
+			{
+				float seconds_per_pixel = batch_seconds_per_pixel[batch];
+				if (seconds_per_pixel == 0.0f && measured_pixels > 0)
+					seconds_per_pixel = measured_seconds / float(measured_pixels);
+				if (batch_start + float(batch_pixels) * seconds_per_pixel > budget) //the batch would miss the deadline
+				{
+					deadline_hit = true;
+					break;
+				}
+			}
+
+			job.first_tile = first_tile;
+			poolRun(batch_end - first_tile, renderTileTask, &job, true);
+			for (uint32_t t = first_tile; t < batch_end; t++)
+				tile_passes[t] = pass + 1;
+
+			if (batch_pixels > 0)
+			{
+				const float batch_seconds = renderSeconds() - batch_start;
+				batch_seconds_per_pixel[batch] = batch_seconds / float(batch_pixels);
+				if (pass == 0)
+				{
+					measured_seconds += batch_seconds;
+					measured_pixels += batch_pixels;
+				}
+			}
+
+			const bool done = pass + 1 == progressive_pass_count && batch_end == tile_count; //the final image is written by the caller
+			const float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - last_snapshot).count();
+			if (progressive_interval > 0.0f && !done && elapsed >= progressive_interval)
+			{
+				upscaleProgressive(job, tile_passes, snapshot);
+				std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+				const bool written = saveImage(filename, snapshot);
+				statsPhaseEnd(PHASE_WRITE, write_start);
+				if (!written)
+				{
+					*message_stream << "Writing the snapshot went wrong!" << std::endl;
+					std::free(snapshot);
+					return false;
+				}
+				*message_stream << "Snapshot written during pass " << (pass + 1) << " of " << progressive_pass_count << std::endl;
+				last_snapshot = std::chrono::steady_clock::now();
+			}
+		}
+
+		if (budget > 0.0f && !deadline_hit && quality_level < quality_level_count) //predict the passes left and step down if they do not fit
+		{
+			float predicted = renderSeconds();
+			for (uint32_t next = pass + 1; next < progressive_pass_count; next++)
+			{
+				for (uint32_t t = 0; t < tile_count; t++)
+					predicted += float(latticePixelCount(job.tiles[t], progressive_passes[next].lattice)) * batch_seconds_per_pixel[t / batch_size];
+			}
+
+			if (predicted > budget)
+			{
+				const QualityLevel& level = quality_levels[quality_level];
+				ao_steps = glm::min(default_ao_steps, level.ao_steps);
+				max_iterations = glm::min(default_max_iterations, level.max_iterations);
+				relaxation = glm::max(default_relaxation, level.relaxation);
+				lowered_in_pass[quality_level++] = pass + 2;
+			}
+		}
+	}
+
+	if (deadline_hit) //the best we have is the upscaled image
+	{
+		upscaleProgressive(job, tile_passes, image);
+		upscaleAovs(job, tile_passes);
+	}
+	std::free(snapshot);
+
+	if (budget > 0.0f) //report what the budget cost
+	{
+		*message_stream << "Budget: " << budget_ms << " ms, rendering took " << uint32_t(renderSeconds() * 1000.0f) << " ms" << std::endl;
+		for (uint32_t i = 0; i < quality_level; i++)
+			*message_stream << "Budget: " << quality_levels[i].description << " from pass " << lowered_in_pass[i] << " on" << std::endl;
+
+		uint32_t min_passes = progressive_pass_count;
+		for (uint32_t t = 0; t < tile_count; t++)
+			min_passes = glm::min(min_passes, tile_passes[t]);
+		if (deadline_hit && min_passes == 0)
+			*message_stream << "Budget: stopped during the first pass, some tiles are black" << std::endl;
+		else if (deadline_hit)
+			*message_stream << "Budget: refinement stopped during pass " << (min_passes + 1) << " of " << progressive_pass_count << ", some pixels are upscaled from blocks of " << progressive_passes[min_passes - 1].block_width << "x" << progressive_passes[min_passes - 1].block_height << std::endl;
+		if (quality_level == 0 && !deadline_hit)
+			*message_stream << "Budget: full quality" << std::endl;
+	}
+	return true;
+}
+
+/// <summary>
+/// Places the camera at one of the preset views of the fractal.
+/// </summary>
+/// <param name="name">The name of the view: front, edge or back.</param>
+/// <returns>False if there is no view of that name. The camera is left untouched then.</returns>
+bool rendererSetCamera(const char* name)
+{
+	if (strcmp("front", name) == 0)
+	{
+		camera_pos = float3(10, 0, 2);
+		camera_view = float3(-1, 0, 0);
+		camera_up = float3(0, 1, 0);
+		camera_side = float3(0, 0, -1);
+	}
+	else if (strcmp("edge", name) == 0)
+	{
+		camera_pos = float3(5.15f, 6.15f, -7.65f);
+		camera_view = glm::normalize(float3(-1.0f, -1.0f, 1.0f));
+		camera_side = glm::normalize(glm::cross(camera_view, float3(0, -1, 0)));
+		camera_up = glm::normalize(glm::cross(camera_view, camera_side));
+	}
+	else if (strcmp("back", name) == 0)
+	{
+		camera_pos = float3(-3.75, 0, +7.25);
+		camera_view = float3(0, 0, -1);
+		camera_up = glm::normalize(float3(0.25f, 1.0f, 0.0f));
+		camera_side = glm::normalize(glm::cross(camera_up, camera_view));
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Derives the values that depend on the configuration: the bounds of the fractal, the pixel count and size and the opening of the view. Call it after the configuration and the fractal parameters are set and before rendering.
+/// </summary>
+void rendererPrepare()
+{
+	pixel_count = width * height;
+	frame_pixel_size = frameFormatPixelSize(frame_format);
+
+	float screen_ratio = float(height) / float(width);
+	tan_hori = glm::tan(fov);
+	tan_vert = tan_hori * screen_ratio;
+
+	//a ray hits once d < pixel_radius * (distance + d), and it never marches beyond max_distance
+	float pixel_radius = primaryPixelRadius();
+	bounds_half_size = pixel_radius < 1.0f ? mandelBoxGetBoundingHalfSize(pixel_radius * max_distance / (1.0f - pixel_radius)) : std::numeric_limits<float>::infinity();
+}
+
+/// <summary>
+/// Allocates the buffers for rendering a number of rows at a time: the image, unless it is mapped already, the beam distances and the enabled AOV layers. The memory is not cleared, see touchTileTask.
+/// </summary>
+/// <param name="rows">The rows the buffers hold, the height for whole frames.</param>
+/// <returns>False if memory could not be allocated. Whatever was allocated is freed again then.</returns>
+bool renderBuffersCreate(const uint32_t& rows)
+{
+	if (!image_mapped)
+	{
+		image = (uint8_t*)std::malloc(size_t(frame_pixel_size)*width*rows);
+		if (image == nullptr)
+		{
+			*message_stream << "Could not allocate the necessary memory for the image buffer!" << std::endl;
+			return false;
+		}
+	}
+
+	if (beam_size > 0)
+	{
+		beam_distance = (float*)std::malloc(sizeof(float)*width*rows);
+		if (beam_distance == nullptr)
+		{
+			*message_stream << "Could not allocate the necessary memory for the beam buffer!" << std::endl;
+			renderBuffersDestroy();
+			return false;
+		}
+	}
+
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+	{
+		if (!aov_enabled[layer])
+			continue;
+		aov_buffers[layer] = (float*)std::malloc(sizeof(float)*aov_layers[layer].channels*width*rows);
+		if (aov_buffers[layer] == nullptr)
+		{
+			*message_stream << "Could not allocate the necessary memory for the AOV buffers!" << std::endl;
+			renderBuffersDestroy();
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Frees the buffers allocated by renderBuffersCreate. A mapped image is only forgotten, closing the mapping is up to whoever opened it.
+/// </summary>
+void renderBuffersDestroy()
+{
+	std::free(beam_distance);
+	beam_distance = nullptr;
+	aovBuffersFree();
+	if (!image_mapped)
+		std::free(image);
+	image = nullptr;
+}
+
+/// <summary>
+/// Renders the rows y0 to y1 - 1 into image, which has to hold them from image_y0 = y0 on. Splits them into tiles, lets the threads touch their tiles first and renders them, progressively if configured and the whole frame is rendered at once.
+/// </summary>
+/// <param name="y0">The first row.</param>
+/// <param name="y1">The row past the last one.</param>
+/// <param name="filename">The output file, for the snapshots of the progressive rendering.</param>
+/// <returns>False if buffers could not be allocated or snapshots could not be written.</returns>
+bool renderRows(const uint32_t& y0, const uint32_t& y1, const char* filename)
+{
+	TileJob job;
+	tilesBuild(width, y1 - y0, tile_size, tile_order, job.tiles);
+	for (size_t i = 0; i < job.tiles.size(); i++) //the tiles were built for the rows alone
+	{
+		job.tiles[i].y0 += y0;
+		job.tiles[i].y1 += y0;
+	}
+	const uint32_t tile_count = uint32_t(job.tiles.size());
+	TileBuffer no_buffer = { nullptr, 0, 0, nullptr };
+	job.buffers.assign(poolGetThreadCount(), no_buffer);
+	job.buffers_missing = false;
+	job.first_tile = 0;
+	job.lattice = full_lattice;
+	job.first_visit = true;
+
+	perfSampleThreads(perfBeginTask, PHASE_CLEAR);
+	std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+	poolRun(tile_count, touchTileTask, &job, false); //first touch of the image by the threads that own the tiles
+	statsPhaseEnd(PHASE_CLEAR, phase_start);
+	perfSampleThreads(perfEndTask, PHASE_CLEAR);
+
+	perfSampleThreads(perfBeginTask, PHASE_RENDER);
+	phase_start = std::chrono::steady_clock::now();
+	bool rendered = true;
+	const double snapshot_seconds = statsPhaseGet(PHASE_WRITE);
+	if (band_rows == 0 && (progressive_interval > 0.0f || budget_ms > 0.0f))
+		rendered = renderProgressive(filename, job);
+	else
+		poolRun(tile_count, renderTileTask, &job, true);
+	statsPhaseEnd(PHASE_RENDER, phase_start);
+	statsPhaseAdd(PHASE_RENDER, snapshot_seconds - statsPhaseGet(PHASE_WRITE)); //the snapshots count as writing
+	perfSampleThreads(perfEndTask, PHASE_RENDER);
+
+	for (size_t i = 0; i < job.buffers.size(); i++)
+		tileBufferDestroy(job.buffers[i]);
+	if (job.buffers_missing)
+	{
+		*message_stream << "Could not allocate the necessary memory for the tile buffers!" << std::endl;
+		return false;
+	}
+	return rendered;
+}
+
+/// <summary>
+/// The G-buffer of an earlier run, as loaded from its AOV layers.
+/// </summary>
+struct GBuffer
+{
+	const float3* normals;
+	const float3* colors; //the orbit trap colors
+	const float* ao; //1 for every pixel if the layer was not written
+	uint32_t rows_per_task;
+};
+
+/// <summary>
+/// Pool task that shades rows of the G-buffer into the image. The view directions are those of the primary rays, so the camera has to match the run that wrote the G-buffer. Misses have a zero normal and color and come out black.
+/// </summary>
+/// <param name="task">The number of the first row divided by rows_per_task.</param>
+/// <param name="thread_index">Unused.</param>
+/// <param name="data">The GBuffer.</param>
+void reshadeRowsTask(const uint32_t& task, const uint32_t& /*thread_index*/, void* data)
+{
+	const GBuffer& gbuffer = *static_cast<const GBuffer*>(data);
+	std::vector<float3> eye_dirs(width);
+	std::vector<float3> shaded(width);
+
+	const uint32_t y1 = glm::min((task + 1) * gbuffer.rows_per_task, height);
+	for (uint32_t y = task * gbuffer.rows_per_task; y < y1; y++)
+	{
+		const size_t row = imageIndex(0, y);
+		for (uint32_t x = 0; x < width; x++)
+			eye_dirs[x] = -primaryRayDir(x, y);
+
+		brdfBlinnPhongBatch(gbuffer.normals + row, gbuffer.colors + row, gbuffer.ao + row, eye_dirs.data(), width, shading_factors, light_dir, light_color, shaded.data());
+		for (uint32_t x = 0; x < width; x++)
+			shaded[x] = glm::pow(shaded[x], float3(output_inverse_gamma, output_inverse_gamma, output_inverse_gamma)); //SRGB correction
+
+		frameEncodeRow(frame_format, shaded.data(), width, image + row * frame_pixel_size);
+	}
+}
+
+/// <summary>
+/// Shades the G-buffer written by an earlier run with aov: (at least normal and trap, ao is optional) with the current light, material and gamma settings, without marching a single ray. The size of the image is taken from the G-buffer.
+/// Loading the G-buffer counts as allocating, the shading as rendering.
+/// </summary>
+/// <param name="source">The output file of the earlier run. The layers are found next to it, see aovFilename.</param>
+/// <param name="filename">The output file.</param>
+/// <returns>False if the G-buffer could not be loaded or the output not be written.</returns>
+bool reshadeImage(const char* source, const char* filename)
+{
+	uint32_t layer_width[AOV_COUNT] = {};
+	uint32_t layer_height[AOV_COUNT] = {};
+	uint32_t layer_channels[AOV_COUNT] = {};
+	float* layers[AOV_COUNT] = {};
+	const uint32_t needed[] = { AOV_NORMAL, AOV_TRAP, AOV_AO };
+	std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+	bool chk = true;
+	for (uint32_t layer : needed)
+	{
+		layers[layer] = loadFloatImagePFM(aovFilename(source, layer).c_str(), layer_width[layer], layer_height[layer], layer_channels[layer]);
+		const bool valid = layers[layer] != nullptr && layer_channels[layer] == aov_layers[layer].channels && layer_width[layer] == layer_width[AOV_NORMAL] && layer_height[layer] == layer_height[AOV_NORMAL];
+		if (!valid && (layer != AOV_AO || layers[layer] != nullptr))
+		{
+			*message_stream << "Could not load the G-buffer layer " << aovFilename(source, layer) << "!" << std::endl;
+			chk = false;
+		}
+	}
+
+	std::vector<float> no_ao;
+	if (chk)
+	{
+		width = layer_width[AOV_NORMAL];
+		height = layer_height[AOV_NORMAL];
+		pixel_count = width * height;
+		tan_hori = glm::tan(fov);
+		tan_vert = tan_hori * float(height) / float(width);
+		if (layers[AOV_AO] == nullptr)
+			no_ao.assign(pixel_count, 1.0f);
+
+		image = (uint8_t*)std::malloc(size_t(frame_pixel_size)*pixel_count);
+		chk = image != nullptr;
+		if (!chk)
+			*message_stream << "Could not allocate the necessary memory for the image buffer!" << std::endl;
+	}
+
+	if (chk)
+	{
+		phase_start = statsPhaseEnd(PHASE_ALLOCATE, phase_start);
+		perfSampleThreads(perfBeginTask, PHASE_RENDER);
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GBuffer gbuffer;
+		gbuffer.normals = reinterpret_cast<const float3*>(layers[AOV_NORMAL]);
+		gbuffer.colors = reinterpret_cast<const float3*>(layers[AOV_TRAP]);
+		gbuffer.ao = layers[AOV_AO] != nullptr ? layers[AOV_AO] : no_ao.data();
+		gbuffer.rows_per_task = 8;
+		poolRun((height + gbuffer.rows_per_task - 1) / gbuffer.rows_per_task, reshadeRowsTask, &gbuffer, true);
+		phase_start = statsPhaseEnd(PHASE_RENDER, start);
+		perfSampleThreads(perfEndTask, PHASE_RENDER);
+		*message_stream << "Reshaded " << width << "x" << height << " pixels in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+		chk = saveImage(filename, image);
+		if (!chk)
+			*message_stream << "Writing the output file went wrong!" << std::endl;
+		statsPhaseEnd(PHASE_WRITE, phase_start);
+	}
+
+	poolShutdown();
+	for (uint32_t layer = 0; layer < AOV_COUNT; layer++)
+		std::free(layers[layer]);
+	std::free(image);
+	image = nullptr;
+	return chk;
+}
+
@@ -0,0 +1,158 @@
+/**
+ * Contains the renderer of the Mandelbox.
+ * The configuration lives in global variables,
+ * set them, call rendererPrepare and render
+ * rows into the image buffer
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+#include <ostream>
+#include "glm/glm.hpp"
+#include "defines.h"
+#include "image.h"
+#include "tiles.h"
+#include "framebuffer.h"
+
+enum NormalMode
+{
+	NORMAL_ANALYTIC, //gradient of the distance estimator, evaluated in the same pass
+	NORMAL_FINITE_DIFFERENCE //central differences, six distance evaluations per attempt
+};
+
+enum BoundsMode
+{
+	BOUNDS_OFF, //primary rays march from the camera to max_distance
+	BOUNDS_CLIP, //rays that miss the bounds are not marched, the others stop where they leave them. Renders the same image as BOUNDS_OFF
+	BOUNDS_ENTER //like BOUNDS_CLIP, and rays start marching where they enter the bounds. Fewer steps, but hits land elsewhere within the termination shell
+};
+
+//arbitrary output variables, written to files of their own next to the output
+enum AovLayer
+{
+	AOV_DEPTH = 0, //distance from the camera along the ray, max_distance for misses
+	AOV_NORMAL,
+	AOV_AO,
+	AOV_STEPS, //march steps of the primary ray, also for misses
+	AOV_TRAP, //the orbit trap color of the surface
+	AOV_COST, //march steps, DE evaluations and nanoseconds spent on the pixel
+	AOV_COUNT
+};
+
+struct AovLayerInfo
+{
+	const char* name; //also the suffix of the file
+	uint32_t channels;
+};
+
+extern const float max_distance;
+extern const uint32_t max_packet_lanes;
+
+//-----------------------------------------|
+// configuration variables for rendering,  |
+// see renderer.cpp for their defaults     |
+//-----------------------------------------|
+
+extern float3 light_dir;
+extern float3 light_color;
+extern float3 shading_factors;
+extern float output_inverse_gamma;
+
+extern uint8_t* image;
+extern uint32_t image_y0;
+extern FrameFormat frame_format;
+extern uint32_t frame_pixel_size;
+
+extern uint32_t width;
+extern uint32_t height;
+extern uint32_t pixel_count;
+
+extern float3 camera_pos;
+extern float3 camera_view;
+extern float3 camera_up;
+extern float3 camera_side;
+extern float fov;
+extern float tan_hori;
+extern float tan_vert;
+
+extern float ao_radius;
+extern float ao_steps;
+extern uint32_t max_iterations;
+
+extern BoundsMode bounds_mode;
+extern float bounds_half_size;
+
+extern NormalMode normal_mode;
+
+extern float relaxation;
+
+extern uint32_t tile_size;
+extern TileOrder tile_order;
+
+extern uint32_t beam_size;
+extern float* beam_distance;
+
+extern uint32_t band_rows;
+extern bool image_mapped;
+
+extern const AovLayerInfo aov_layers[AOV_COUNT];
+extern bool aov_enabled[AOV_COUNT];
+extern float* aov_buffers[AOV_COUNT];
+extern uint32_t heatmap_channel;
+
+extern bool bmp_dither;
+extern bool bmp_cimg;
+
+extern float progressive_interval;
+extern float budget_ms;
+extern std::chrono::steady_clock::time_point render_start;
+
+extern uint32_t packet_width;
+extern uint32_t packet_height;
+
+extern std::ostream* message_stream;
+
+float3 approxNormal(const float3& pos);
+
+float approxAmbientOcclusion(const float3& pos, const float3& normal, const float& ao_distance);
+
+bool rayTrace(float3& ray_pos, const float3& ray_dir, const float& pixel_radius, float& distance, const float& end_distance, uint32_t& steps);
+
+float3 primaryRayDir(const float& x, const float& y);
+
+float primaryPixelRadius();
+
+bool startPrimaryRay(const uint32_t& x, const uint32_t& y, const float3& ray_dir, float& start_distance, float& end_distance);
+
+bool startsWith(const char *pre, const char *str);
+
+bool endsWith(const char *post, const char *str);
+
+bool saveImage(const char* filename, const uint8_t* pixels);
+
+std::string aovFilename(const char* output, const uint32_t& layer);
+
+bool aovStreamsOpen(const char* output, FrameStream* streams);
+
+bool aovStreamsWriteRows(FrameStream* streams, const uint32_t& row_count);
+
+bool aovStreamsClose(FrameStream* streams);
+
+void aovBuffersFree();
+
+bool saveCostHeatmap(const char* output);
+
+bool rendererSetCamera(const char* name);
+
+void rendererPrepare();
+
+bool renderBuffersCreate(const uint32_t& rows);
+
+void renderBuffersDestroy();
+
+bool renderRows(const uint32_t& y0, const uint32_t& y1, const char* filename);
+
+bool reshadeImage(const char* source, const char* filename);
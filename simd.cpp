@@ -0,0 +1,150 @@
+/**
+ * Contains declerations for simd.h
+ */
+
+#include "simd.h"
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SIMD_CPUID_MSVC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_CPUID_GNU
+#endif
+
+#if defined(SIMD_CPUID_MSVC)
+/// <summary>
+/// Queries cpuid and the OS managed register state for the given instruction set.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>True if the CPU and the OS support the instruction set.</returns>
+static bool cpuSupportsMSVC(const SimdIsa& isa)
+{
+	int32_t info[4];
+	__cpuid(info, 0);
+	const int32_t max_leaf = info[0];
+	if (max_leaf < 1)
+		return false;
+
+	__cpuidex(info, 1, 0);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (isa == SIMD_SSE)
+		return sse41;
+	if (!osxsave || max_leaf < 7)
+		return false;
+
+	const uint64_t xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if (isa == SIMD_AVX2)
+		return fma && (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+	if (isa == SIMD_AVX512)
+		return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+	return false;
+}
+#endif
+
+/// <summary>
+/// Checks if the CPU we are running on can execute code for a given instruction set.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>True if the instruction set can be used. SIMD_SCALAR is always supported.</returns>
+bool simdIsaSupported(const SimdIsa& isa)
+{
+#if defined(SIMD_CPUID_GNU)
+	__builtin_cpu_init(); //we might be called during static initialization
+#endif
+
+	switch (isa)
+	{
+	case SIMD_SCALAR:
+		return true;
+#if defined(SIMD_CPUID_GNU)
+	case SIMD_SSE:
+		return __builtin_cpu_supports("sse4.1") != 0;
+	case SIMD_AVX2:
+		return __builtin_cpu_supports("avx2") != 0 && __builtin_cpu_supports("fma") != 0;
+	case SIMD_AVX512:
+		return __builtin_cpu_supports("avx512f") != 0;
+#elif defined(SIMD_CPUID_MSVC)
+	case SIMD_SSE:
+	case SIMD_AVX2:
+	case SIMD_AVX512:
+		return cpuSupportsMSVC(isa);
+#endif
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Returns the widest instruction set supported by the CPU.
+/// </summary>
+/// <returns>The widest supported instruction set.</returns>
+SimdIsa simdBestIsa()
+{
+	for (int32_t i = SIMD_ISA_COUNT - 1; i > SIMD_SCALAR; i--)
+	{
+		if (simdIsaSupported(SimdIsa(i)))
+			return SimdIsa(i);
+	}
+	return SIMD_SCALAR;
+}
+
+/// <summary>
+/// Returns a human readable name of an instruction set. Matches the names accepted by simdIsaFromName.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>The name of the instruction set.</returns>
+const char* simdIsaName(const SimdIsa& isa)
+{
+	switch (isa)
+	{
+	case SIMD_SCALAR: return "scalar";
+	case SIMD_SSE: return "sse4.1";
+	case SIMD_AVX2: return "avx2";
+	case SIMD_AVX512: return "avx512";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Parses the name of an instruction set.
+/// </summary>
+/// <param name="name">The name as returned by simdIsaName. "sse" is accepted as well.</param>
+/// <param name="isa">[OUT] The parsed instruction set.</param>
+/// <returns>True if the name was valid, false otherwise.</returns>
+bool simdIsaFromName(const char* name, SimdIsa& isa)
+{
+	for (int32_t i = 0; i < SIMD_ISA_COUNT; i++)
+	{
+		if (strcmp(name, simdIsaName(SimdIsa(i))) == 0)
+		{
+			isa = SimdIsa(i);
+			return true;
+		}
+	}
+	if (strcmp(name, "sse") == 0)
+	{
+		isa = SIMD_SSE;
+		return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// Returns the number of float lanes of an instruction set.
+/// </summary>
+/// <param name="isa">The instruction set.</param>
+/// <returns>The number of lanes.</returns>
+uint32_t simdIsaWidth(const SimdIsa& isa)
+{
+	switch (isa)
+	{
+	case SIMD_SSE: return 4;
+	case SIMD_AVX2: return 8;
+	case SIMD_AVX512: return 16;
+	default: return 1;
+	}
+}
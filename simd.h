@@ -0,0 +1,28 @@
+/**
+ * Contains functionality to detect and select
+ * the SIMD instruction sets used by the
+ * vectorized kernels
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+enum SimdIsa
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE,
+	SIMD_AVX2,
+	SIMD_AVX512,
+	SIMD_ISA_COUNT
+};
+
+bool simdIsaSupported(const SimdIsa& isa);
+
+SimdIsa simdBestIsa();
+
+const char* simdIsaName(const SimdIsa& isa);
+
+bool simdIsaFromName(const char* name, SimdIsa& isa);
+
+uint32_t simdIsaWidth(const SimdIsa& isa);
@@ -0,0 +1,215 @@
+/**
+ * Contains declerations for stats.h
+ */
+
+#include "stats.h"
+#include "trace.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/// <summary>
+/// The counters of one thread. Registers itself so the values can be merged, and hands its values over when the thread ends. Created when the thread counts the first time.
+/// </summary>
+struct ThreadCounters
+{
+	uint64_t values[STAT_COUNTER_COUNT];
+
+	ThreadCounters();
+	~ThreadCounters();
+};
+
+static std::mutex registry_mutex;
+static std::vector<ThreadCounters*> registry; //counters of all running threads
+static uint64_t retired[STAT_COUNTER_COUNT] = { 0 }; //values of threads that already ended
+
+bool stats_enabled = false; //counting costs a call per event, so it is off unless the counters are read
+
+static thread_local ThreadCounters thread_counters;
+static thread_local uint64_t* thread_values = nullptr; //the values of thread_counters once it exists. Constant initialized, so reading it needs no guard, unlike thread_counters
+
+static double phase_seconds[PHASE_COUNT] = { 0.0 };
+
+ThreadCounters::ThreadCounters()
+{
+	std::fill(values, values + STAT_COUNTER_COUNT, 0);
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	registry.push_back(this);
+	thread_values = values;
+}
+
+ThreadCounters::~ThreadCounters()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (uint32_t i = 0; i < STAT_COUNTER_COUNT; i++)
+		retired[i] += values[i];
+	registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+	thread_values = nullptr;
+}
+
+/// <summary>
+/// Turns counting on or off. Not thread safe, call it between jobs. The values counted so far are kept.
+/// </summary>
+/// <param name="enable">True to count, e.g. when the statistics or the cost layer are written.</param>
+void statsEnable(const bool& enable)
+{
+	stats_enabled = enable;
+}
+
+/// <summary>
+/// Adds a value to a counter of the calling thread. Call statsAdd instead, which skips the call while counting is off.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <param name="value">The value to add.</param>
+void statsCount(const StatCounter& counter, const uint64_t& value)
+{
+	uint64_t* values = thread_values;
+	if (values == nullptr) //the first count of this thread registers its counters
+		values = thread_counters.values;
+	values[counter] += value;
+}
+
+/// <summary>
+/// Returns the value of a counter summed over all threads. Only call it while no other thread is counting, e.g. after a parallel section.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <returns>The merged value.</returns>
+uint64_t statsGet(const StatCounter& counter)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	uint64_t value = retired[counter];
+	for (const ThreadCounters* counters : registry)
+		value += counters->values[counter];
+	return value;
+}
+
+/// <summary>
+/// Returns the value of a counter of the calling thread only.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <returns>The value counted by this thread.</returns>
+uint64_t statsThreadGet(const StatCounter& counter)
+{
+	return thread_values != nullptr ? thread_values[counter] : 0;
+}
+
+/// <summary>
+/// Sets all counters of all threads and the phase times to zero. Only call it while no other thread is counting.
+/// </summary>
+void statsReset()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::fill(retired, retired + STAT_COUNTER_COUNT, 0);
+	for (ThreadCounters* counters : registry)
+		std::fill(counters->values, counters->values + STAT_COUNTER_COUNT, 0);
+	std::fill(phase_seconds, phase_seconds + PHASE_COUNT, 0.0);
+}
+
+/// <summary>
+/// Returns a human readable name of a counter.
+/// </summary>
+/// <param name="counter">The counter.</param>
+/// <returns>The name.</returns>
+const char* statsCounterName(const StatCounter& counter)
+{
+	switch (counter)
+	{
+	case STAT_DE_EVALUATIONS: return "DE evaluations";
+	case STAT_DE_ITERATIONS: return "DE iterations";
+	case STAT_PRIMARY_RAYS: return "Primary rays";
+	case STAT_PRIMARY_HITS: return "Primary hits";
+	case STAT_MARCH_STEPS: return "March steps";
+	case STAT_BEAM_STEPS: return "Beam steps";
+	case STAT_NORMAL_EVALUATIONS: return "Normal evaluations";
+	case STAT_AO_EVALUATIONS: return "AO evaluations";
+	case STAT_COLOR_EVALUATIONS: return "Color evaluations";
+	case STAT_OVERSTEPS: return "Oversteps recovered";
+	case STAT_RAYS_CULLED: return "Rays culled by bounds";
+	case STAT_RAYS_CLIPPED: return "Rays clipped by bounds";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Adds the time since start to a phase. Phases are timed on the main thread only, and a phase may be timed in several parts, e.g. once per band. Every part also becomes an event on the main thread of the trace, if it is recorded.
+/// </summary>
+/// <param name="phase">The phase.</param>
+/// <param name="start">When the phase started.</param>
+/// <returns>The current time, which is where the next phase starts.</returns>
+std::chrono::steady_clock::time_point statsPhaseEnd(const StatPhase& phase, const std::chrono::steady_clock::time_point& start)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	phase_seconds[phase] += std::chrono::duration<double>(now - start).count();
+	traceEvent(0, statsPhaseName(phase), "phase", start, now);
+	return now;
+}
+
+/// <summary>
+/// Adds time to a phase directly, e.g. to move time that was counted twice from one phase to another.
+/// </summary>
+/// <param name="phase">The phase.</param>
+/// <param name="seconds">The time to add. May be negative.</param>
+void statsPhaseAdd(const StatPhase& phase, const double& seconds)
+{
+	phase_seconds[phase] += seconds;
+}
+
+/// <summary>
+/// Returns the time spent in a phase.
+/// </summary>
+/// <param name="phase">The phase.</param>
+/// <returns>The time in seconds.</returns>
+double statsPhaseGet(const StatPhase& phase)
+{
+	return phase_seconds[phase];
+}
+
+/// <summary>
+/// Returns a human readable name of a phase.
+/// </summary>
+/// <param name="phase">The phase.</param>
+/// <returns>The name.</returns>
+const char* statsPhaseName(const StatPhase& phase)
+{
+	switch (phase)
+	{
+	case PHASE_PARSE: return "parse";
+	case PHASE_ALLOCATE: return "allocate";
+	case PHASE_CLEAR: return "clear";
+	case PHASE_RENDER: return "render";
+	case PHASE_WRITE: return "write";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Returns the most memory the process had resident at once so far.
+/// </summary>
+/// <returns>The peak resident set size in bytes. 0 if the OS does not tell.</returns>
+uint64_t statsPeakMemory()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return uint64_t(counters.PeakWorkingSetSize);
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return uint64_t(usage.ru_maxrss); //bytes on macOS
+#else
+	return uint64_t(usage.ru_maxrss) * 1024; //kilobytes elsewhere
+#endif
+#endif
+}
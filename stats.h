@@ -0,0 +1,72 @@
+/**
+ * Contains lightweight statistic counters.
+ * Every thread counts on its own, the values
+ * are merged when they are read. Counting is
+ * off unless statsEnable turns it on. Also times
+ * the phases of a run and reads the peak
+ * memory use
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+enum StatCounter
+{
+	STAT_DE_EVALUATIONS = 0, //calls of the distance estimator, SIMD lanes count individually
+	STAT_DE_ITERATIONS, //fractal iterations actually done by those calls
+	STAT_PRIMARY_RAYS,
+	STAT_PRIMARY_HITS, //primary rays that hit the fractal
+	STAT_MARCH_STEPS, //distance evaluations while marching primary rays
+	STAT_BEAM_STEPS, //distance evaluations of beams that cover several primary rays
+	STAT_NORMAL_EVALUATIONS, //distance evaluations for normals, gradients included
+	STAT_AO_EVALUATIONS, //distance evaluations for the ambient occlusion
+	STAT_COLOR_EVALUATIONS, //orbit traps evaluated for the surface color
+	STAT_OVERSTEPS, //over-relaxed steps that jumped too far and were taken back
+	STAT_RAYS_CULLED, //primary rays that missed the bounding box and were not marched at all
+	STAT_RAYS_CLIPPED, //primary rays whose marching the bounding box shortened
+	STAT_COUNTER_COUNT
+};
+
+//phases of a run, timed on the main thread
+enum StatPhase
+{
+	PHASE_PARSE = 0, //reading the command line
+	PHASE_ALLOCATE, //allocating or mapping the buffers
+	PHASE_CLEAR, //first touch and clearing of the buffers by the render threads
+	PHASE_RENDER,
+	PHASE_WRITE, //writing the output files, snapshots included
+	PHASE_COUNT
+};
+
+extern bool stats_enabled;
+
+void statsEnable(const bool& enable);
+
+void statsCount(const StatCounter& counter, const uint64_t& value);
+
+//adds a value to a counter of the calling thread. Inline, so the distance estimator and the marching only pay a branch while counting is off
+inline void statsAdd(const StatCounter& counter, const uint64_t& value)
+{
+	if (stats_enabled)
+		statsCount(counter, value);
+}
+
+uint64_t statsGet(const StatCounter& counter);
+
+uint64_t statsThreadGet(const StatCounter& counter);
+
+void statsReset();
+
+const char* statsCounterName(const StatCounter& counter);
+
+std::chrono::steady_clock::time_point statsPhaseEnd(const StatPhase& phase, const std::chrono::steady_clock::time_point& start);
+
+void statsPhaseAdd(const StatPhase& phase, const double& seconds);
+
+double statsPhaseGet(const StatPhase& phase);
+
+const char* statsPhaseName(const StatPhase& phase);
+
+uint64_t statsPeakMemory();
@@ -0,0 +1,242 @@
+/**
+ * Contains declerations for tiles.h
+ */
+
+#include "tiles.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+/// <summary>
+/// Extracts every second bit of a morton code.
+/// </summary>
+/// <param name="code">The morton code, shifted so the wanted coordinate is in the even bits.</param>
+/// <returns>The coordinate.</returns>
+static uint32_t mortonCompact(uint32_t code)
+{
+	code &= 0x55555555;
+	code = (code | (code >> 1)) & 0x33333333;
+	code = (code | (code >> 2)) & 0x0f0f0f0f;
+	code = (code | (code >> 4)) & 0x00ff00ff;
+	code = (code | (code >> 8)) & 0x0000ffff;
+	return code;
+}
+
+/// <summary>
+/// Converts a position along the hilbert curve into coordinates.
+/// </summary>
+/// <param name="n">Side length of the square the curve covers. Must be a power of two.</param>
+/// <param name="d">The position along the curve.</param>
+/// <param name="x">[OUT] The x coordinate.</param>
+/// <param name="y">[OUT] The y coordinate.</param>
+static void hilbertToXY(const uint32_t& n, uint32_t d, uint32_t& x, uint32_t& y)
+{
+	x = 0;
+	y = 0;
+	for (uint32_t s = 1; s < n; s *= 2)
+	{
+		const uint32_t rx = 1 & (d / 2);
+		const uint32_t ry = 1 & (d ^ rx);
+		if (ry == 0) //rotate the quadrant
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			const uint32_t tmp = x;
+			x = y;
+			y = tmp;
+		}
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+}
+
+/// <summary>
+/// Splits an image into tiles and orders them. Morton and hilbert order walk power of two squares over the tile grid and skip what lies outside, so neighbouring tiles are rendered close in time and share the cache for the fractal and the image rows. Grids much wider than high (or the other way around) are covered by a row of squares as high as the grid, so the curves never walk far outside of it. The hilbert curve ends next to where the next square starts.
+/// </summary>
+/// <param name="width">Width of the image.</param>
+/// <param name="height">Height of the image.</param>
+/// <param name="tile_size">Side length of the tiles. Tiles at the right and upper border are smaller.</param>
+/// <param name="order">The order in which the tiles are listed.</param>
+/// <param name="tiles">[OUT] The tiles.</param>
+void tilesBuild(const uint32_t& width, const uint32_t& height, const uint32_t& tile_size, const TileOrder& order, std::vector<Tile>& tiles)
+{
+	const uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+	const uint32_t tiles_y = (height + tile_size - 1) / tile_size;
+	tiles.clear();
+	tiles.reserve(size_t(tiles_x) * tiles_y);
+
+	const bool wide = tiles_x >= tiles_y;
+	uint32_t n = 1; //side of the squares the curves cover
+	while (n < (wide ? tiles_y : tiles_x))
+		n *= 2;
+	const uint32_t square_count = order == TILE_ORDER_SCANLINE ? 1 : ((wide ? tiles_x : tiles_y) + n - 1) / n;
+	const uint32_t curve_length = order == TILE_ORDER_SCANLINE ? tiles_x * tiles_y : n * n;
+
+	for (uint32_t square = 0; square < square_count; square++)
+	{
+		for (uint32_t d = 0; d < curve_length; d++)
+		{
+			uint32_t tx = 0;
+			uint32_t ty = 0;
+			switch (order)
+			{
+			case TILE_ORDER_MORTON:
+				tx = mortonCompact(d);
+				ty = mortonCompact(d >> 1);
+				break;
+			case TILE_ORDER_HILBERT:
+				hilbertToXY(n, d, tx, ty);
+				break;
+			default:
+				tx = d % tiles_x;
+				ty = d / tiles_x;
+				break;
+			}
+			if (order != TILE_ORDER_SCANLINE)
+			{
+				if (!wide) //the curves run along x, turn them for tall grids
+				{
+					const uint32_t tmp = tx;
+					tx = ty;
+					ty = tmp;
+				}
+				if (wide)
+					tx += square * n;
+				else
+					ty += square * n;
+			}
+			if (tx >= tiles_x || ty >= tiles_y)
+				continue;
+
+			Tile tile;
+			tile.x0 = tx * tile_size;
+			tile.y0 = ty * tile_size;
+			tile.x1 = tile.x0 + tile_size < width ? tile.x0 + tile_size : width;
+			tile.y1 = tile.y0 + tile_size < height ? tile.y0 + tile_size : height;
+			tiles.push_back(tile);
+		}
+	}
+}
+
+/// <summary>
+/// Returns a human readable name of a tile order. Matches the names accepted by tileOrderFromName.
+/// </summary>
+/// <param name="order">The tile order.</param>
+/// <returns>The name of the tile order.</returns>
+const char* tileOrderName(const TileOrder& order)
+{
+	switch (order)
+	{
+	case TILE_ORDER_SCANLINE: return "scanline";
+	case TILE_ORDER_MORTON: return "morton";
+	case TILE_ORDER_HILBERT: return "hilbert";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Parses the name of a tile order.
+/// </summary>
+/// <param name="name">The name as returned by tileOrderName.</param>
+/// <param name="order">[OUT] The parsed tile order.</param>
+/// <returns>True if the name was valid, false otherwise.</returns>
+bool tileOrderFromName(const char* name, TileOrder& order)
+{
+	for (int32_t i = 0; i < TILE_ORDER_COUNT; i++)
+	{
+		if (strcmp(name, tileOrderName(TileOrder(i))) == 0)
+		{
+			order = TileOrder(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Allocates a buffer for one tile. The buffer and each of its rows start at a cache line, so threads never share a line while rendering.
+/// </summary>
+/// <param name="buffer">[OUT] The buffer.</param>
+/// <param name="tile_size">Side length of the tiles the buffer is used for.</param>
+/// <returns>False if the memory could not be allocated.</returns>
+bool tileBufferCreate(TileBuffer& buffer, const uint32_t& tile_size)
+{
+	const uint32_t row_granularity = 16; //16 float3 fill exactly three cache lines
+	buffer.tile_size = tile_size;
+	buffer.stride = (tile_size + row_granularity - 1) / row_granularity * row_granularity;
+
+	buffer.memory = std::malloc(size_t(buffer.stride) * tile_size * sizeof(float3) + cache_line_size);
+	if (buffer.memory == nullptr)
+	{
+		buffer.pixels = nullptr;
+		return false;
+	}
+
+	const uintptr_t address = reinterpret_cast<uintptr_t>(buffer.memory);
+	buffer.pixels = reinterpret_cast<float3*>((address + cache_line_size - 1) / cache_line_size * cache_line_size);
+	return true;
+}
+
+/// <summary>
+/// Frees the memory of a tile buffer.
+/// </summary>
+/// <param name="buffer">[IN/OUT] The buffer.</param>
+void tileBufferDestroy(TileBuffer& buffer)
+{
+	std::free(buffer.memory);
+	buffer.memory = nullptr;
+	buffer.pixels = nullptr;
+}
+
+/// <summary>
+/// Sets the pixels of a tile within the buffer to black.
+/// </summary>
+/// <param name="buffer">[IN/OUT] The buffer.</param>
+/// <param name="tile">The tile that is rendered next.</param>
+void tileBufferClear(TileBuffer& buffer, const Tile& tile)
+{
+	for (uint32_t y = 0; y < tile.y1 - tile.y0; y++)
+	{
+		std::fill(buffer.pixels + y * buffer.stride, buffer.pixels + y * buffer.stride + (tile.x1 - tile.x0), float3(0, 0, 0));
+	}
+}
+
+/// <summary>
+/// Copies a tile of the image into the buffer, row by row, and converts it back to float triplets. Used to continue rendering a tile that was partially rendered before.
+/// </summary>
+/// <param name="buffer">[OUT] The buffer.</param>
+/// <param name="tile">The tile.</param>
+/// <param name="image">The image.</param>
+/// <param name="format">The frame format of the image.</param>
+/// <param name="width">Width of the image.</param>
+/// <param name="image_y0">The first row held by image, when only a band of rows is kept in memory.</param>
+void tileBufferCopyIn(TileBuffer& buffer, const Tile& tile, const void* image, const FrameFormat& format, const uint32_t& width, const uint32_t& image_y0)
+{
+	const size_t pixel_size = frameFormatPixelSize(format);
+	for (uint32_t y = tile.y0; y < tile.y1; y++)
+	{
+		frameDecodeRow(format, static_cast<const uint8_t*>(image) + (size_t(y - image_y0) * width + tile.x0) * pixel_size, tile.x1 - tile.x0, buffer.pixels + (y - tile.y0) * buffer.stride);
+	}
+}
+
+/// <summary>
+/// Copies a rendered tile into the image, row by row, and converts it to the frame format.
+/// </summary>
+/// <param name="buffer">The buffer holding the tile.</param>
+/// <param name="tile">The tile.</param>
+/// <param name="image">The image.</param>
+/// <param name="format">The frame format of the image.</param>
+/// <param name="width">Width of the image.</param>
+/// <param name="image_y0">The first row held by image, when only a band of rows is kept in memory.</param>
+void tileBufferCopyOut(const TileBuffer& buffer, const Tile& tile, void* image, const FrameFormat& format, const uint32_t& width, const uint32_t& image_y0)
+{
+	const size_t pixel_size = frameFormatPixelSize(format);
+	for (uint32_t y = tile.y0; y < tile.y1; y++)
+	{
+		frameEncodeRow(format, buffer.pixels + (y - tile.y0) * buffer.stride, tile.x1 - tile.x0, static_cast<uint8_t*>(image) + (size_t(y - image_y0) * width + tile.x0) * pixel_size);
+	}
+}
@@ -0,0 +1,56 @@
+/**
+ * Contains the tile scheduling of the renderer.
+ * The image is split into tiles that are handed
+ * out along a space filling curve. Every thread
+ * renders a tile into its own cache line aligned
+ * buffer and copies it out afterwards
+ */
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "defines.h"
+#include "framebuffer.h"
+
+const uint32_t cache_line_size = 64;
+
+enum TileOrder
+{
+	TILE_ORDER_SCANLINE = 0,
+	TILE_ORDER_MORTON,
+	TILE_ORDER_HILBERT,
+	TILE_ORDER_COUNT
+};
+
+struct Tile
+{
+	uint32_t x0; //lower left pixel
+	uint32_t y0;
+	uint32_t x1; //past the upper right pixel
+	uint32_t y1;
+};
+
+struct TileBuffer
+{
+	float3* pixels; //row y of a tile starts at pixels + y * stride
+	uint32_t stride; //pixels per row, padded to whole cache lines
+	uint32_t tile_size;
+	void* memory; //the unaligned allocation
+};
+
+void tilesBuild(const uint32_t& width, const uint32_t& height, const uint32_t& tile_size, const TileOrder& order, std::vector<Tile>& tiles);
+
+const char* tileOrderName(const TileOrder& order);
+
+bool tileOrderFromName(const char* name, TileOrder& order);
+
+bool tileBufferCreate(TileBuffer& buffer, const uint32_t& tile_size);
+
+void tileBufferDestroy(TileBuffer& buffer);
+
+void tileBufferClear(TileBuffer& buffer, const Tile& tile);
+
+void tileBufferCopyIn(TileBuffer& buffer, const Tile& tile, const void* image, const FrameFormat& format, const uint32_t& width, const uint32_t& image_y0);
+
+void tileBufferCopyOut(const TileBuffer& buffer, const Tile& tile, void* image, const FrameFormat& format, const uint32_t& width, const uint32_t& image_y0);
@@ -0,0 +1,127 @@
+/**
+ * Contains declerations for trace.h
+ */
+
+#include "trace.h"
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+/// <summary>
+/// A span of time a thread spent on something. Optionally names the rectangle of the image it worked on.
+/// </summary>
+struct TraceEvent
+{
+	const char* name; //must outlive the trace, string literals are fine
+	const char* category;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+	bool has_rect;
+	uint32_t x0; //lower left pixel
+	uint32_t y0;
+	uint32_t x1; //past the upper right pixel
+	uint32_t y1;
+};
+
+static bool enabled = false;
+static std::vector<std::vector<TraceEvent>> thread_events; //one list per thread number, so threads never share one
+
+/// <summary>
+/// Starts or stops recording. Starting drops the events recorded so far. Not thread safe, call it between jobs.
+/// </summary>
+/// <param name="enable">True to record events.</param>
+void traceEnable(const bool& enable)
+{
+	enabled = enable;
+	thread_events.clear();
+	if (enable)
+		thread_events.resize(trace_max_threads);
+}
+
+/// <summary>
+/// Returns if events are recorded. Callers check it before they take timestamps, so a disabled trace costs nothing.
+/// </summary>
+/// <returns>True if events are recorded.</returns>
+bool traceEnabled()
+{
+	return enabled;
+}
+
+/// <summary>
+/// Records that a thread spent some time on something. Threads may record concurrently, as long as no two of them use the same thread number at once, as the threads of the pool do.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool. The main thread is 0.</param>
+/// <param name="name">What the thread did.</param>
+/// <param name="category">The category, which the viewers can filter by.</param>
+/// <param name="start">When it started.</param>
+/// <param name="end">When it ended.</param>
+void traceEvent(const uint32_t& thread_index, const char* name, const char* category, const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end)
+{
+	if (!enabled || thread_index >= trace_max_threads)
+		return;
+	TraceEvent event = { name, category, start, end, false, 0, 0, 0, 0 };
+	thread_events[thread_index].push_back(event);
+}
+
+/// <summary>
+/// Records that a thread spent some time on a rectangle of the image, e.g. a tile.
+/// </summary>
+/// <param name="thread_index">The number of the thread within the pool. The main thread is 0.</param>
+/// <param name="name">What the thread did.</param>
+/// <param name="category">The category, which the viewers can filter by.</param>
+/// <param name="start">When it started.</param>
+/// <param name="end">When it ended.</param>
+/// <param name="x0">The x of the lower left pixel.</param>
+/// <param name="y0">The y of the lower left pixel.</param>
+/// <param name="x1">The x past the upper right pixel.</param>
+/// <param name="y1">The y past the upper right pixel.</param>
+void traceRectEvent(const uint32_t& thread_index, const char* name, const char* category, const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end, const uint32_t& x0, const uint32_t& y0, const uint32_t& x1, const uint32_t& y1)
+{
+	if (!enabled || thread_index >= trace_max_threads)
+		return;
+	TraceEvent event = { name, category, start, end, true, x0, y0, x1, y1 };
+	thread_events[thread_index].push_back(event);
+}
+
+/// <summary>
+/// Writes the recorded events in the trace event format of Chrome. Every event becomes a complete event on the track of its thread, with microsecond timestamps from the start of the earliest event.
+/// </summary>
+/// <param name="filename">The file to write.</param>
+/// <returns>False if the file could not be written.</returns>
+bool traceWrite(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr)
+		return false;
+
+	std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::time_point::max(); //time 0 of the timeline
+	for (uint32_t thread = 0; thread < thread_events.size(); thread++)
+	{
+		for (size_t i = 0; i < thread_events[thread].size(); i++)
+			trace_start = std::min(trace_start, thread_events[thread][i].start);
+	}
+
+	bool first = true;
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	for (uint32_t thread = 0; thread < thread_events.size(); thread++)
+	{
+		const std::vector<TraceEvent>& events = thread_events[thread];
+		if (events.empty())
+			continue;
+
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s %u\"}}", first ? "" : ",\n", thread, thread == 0 ? "main thread" : "worker", thread);
+		first = false;
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const TraceEvent& event = events[i];
+			const double start = std::chrono::duration<double, std::micro>(event.start - trace_start).count();
+			const double duration = std::chrono::duration<double, std::micro>(event.end - event.start).count();
+			fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f", event.name, event.category, thread, start, duration);
+			if (event.has_rect)
+				fprintf(file, ", \"args\": {\"x0\": %u, \"y0\": %u, \"x1\": %u, \"y1\": %u}", event.x0, event.y0, event.x1, event.y1);
+			fprintf(file, "}");
+		}
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * Contains a recorder for a timeline of what
+ * every thread did, e.g. which tile it rendered
+ * when and how long it waited for work. Written
+ * in the trace event format of Chrome, which
+ * chrome://tracing and Perfetto show
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+const uint32_t trace_max_threads = 1024; //events of threads with a higher number are dropped
+
+void traceEnable(const bool& enable);
+
+bool traceEnabled();
+
+void traceEvent(const uint32_t& thread_index, const char* name, const char* category, const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end);
+
+void traceRectEvent(const uint32_t& thread_index, const char* name, const char* category, const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end, const uint32_t& x0, const uint32_t& y0, const uint32_t& x1, const uint32_t& y1);
+
+bool traceWrite(const char* filename);